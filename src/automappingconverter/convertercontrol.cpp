@@ -111,5 +111,8 @@ void ConverterControl::convertV1toV2(const QString &fileName)
     }
 
     Tiled::MapWriter writer;
-    writer.writeMap(map.data(), fileName);
+    if (!writer.writeMap(map.data(), fileName)) {
+        qWarning() << "Error at conversion of " << fileName << ":\n"
+                   << writer.errorString();
+    }
 }
@@ -20,12 +20,17 @@
  */
  
 #include "converterwindow.h"
+#include "tilesetcache.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // Maps loaded by this tool share their external tilesets
+    Tiled::TilesetCache::setEnabled(true);
+
     ConverterWindow w;
     w.show();
 
@@ -0,0 +1,169 @@
+/*
+ * binarymapformat.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILED_BINARYMAPFORMAT_H
+#define TILED_BINARYMAPFORMAT_H
+
+#include "compression.h"
+
+#include <QtGlobal>
+
+namespace Tiled {
+
+/**
+ * Constants of the binary map format, used by BinaryMapReader and
+ * BinaryMapWriter. The format is meant for loading maps quickly, for example
+ * by a game streaming in levels. TMX remains the format to edit maps in.
+ *
+ * All values are little endian and floating point values are IEEE 754
+ * doubles. A file starts with a header:
+ *
+ *   char[4]   magic ("TMB" followed by a zero byte)
+ *   uint16    version
+ *   uint16    reserved
+ *   uint32    section count
+ *   uint32    reserved
+ *
+ * This is followed by the section table, which lists for each section:
+ *
+ *   uint32    type (SectionType)
+ *   uint32    reserved
+ *   uint64    offset from the start of the file, a multiple of 8
+ *   uint64    size in bytes
+ *
+ * The first section is the map, followed by the tilesets and the layers in
+ * order, and finally the string table. Strings are stored as their uint32
+ * index in the string table, where index 0 is the empty string. Colors are
+ * stored as a uint32 ARGB value, where 0 means no color is set. Properties
+ * are stored as a uint32 count, followed by the name and value of each.
+ *
+ * Map section:
+ *   uint8     orientation, render order, stagger axis, stagger index and
+ *             layer data format, followed by 3 reserved bytes
+ *   int32     width, height, tile width, tile height, hex side length,
+ *             compression level and next object ID
+ *   uint32    background color
+ *   properties
+ *
+ * Tileset section:
+ *   uint32    first global tile ID
+ *   uint32    source, the file name of an external tileset relative to the
+ *             map, or the empty string for embedded tilesets
+ *   uint32    size of the embedded tileset, followed by its TSX data
+ *
+ * All layer sections start with:
+ *   uint32    name
+ *   int32     x, y, width and height
+ *   double    opacity
+ *   uint8     visible, followed by 3 reserved bytes
+ *   properties
+ *
+ * Tile layer section:
+ *   uint8     compression (ChunkCompression), followed by 3 reserved bytes
+ *   uint32    chunk width and chunk height
+ *   uint32    chunk count, followed by for each chunk:
+ *     uint64  offset of the chunk data from the start of the section
+ *     uint32  size of the chunk data
+ *     uint32  reserved
+ *
+ * The layer is divided into chunks row by row, where the chunks on the right
+ * and bottom edges are clipped to the layer. A chunk is no larger than the
+ * layer and covers at most maxChunkTiles cells. The data of each chunk is the
+ * array of its uint32 global tile IDs in row-major order, compressed when
+ * the layer says so. Chunks with only empty cells have no data. Uncompressed
+ * chunk data is 4-byte aligned, so it can be used straight from a memory
+ * mapped file.
+ *
+ * Object group section:
+ *   uint32    color
+ *   uint8     draw order, followed by 3 reserved bytes
+ *   uint32    object count, followed by for each object:
+ *     int32   ID
+ *     uint32  name, type and global tile ID
+ *     double  x, y, width, height and rotation
+ *     uint8   shape and visible, followed by 2 reserved bytes
+ *     uint32  point count, followed by the x and y of each point as doubles
+ *     properties
+ *
+ * Image layer section:
+ *   uint32    source, the image file name relative to the map
+ *   uint32    transparent color
+ *
+ * String table section:
+ *   uint32    string count, followed by for each string its uint32 size
+ *             and its UTF-8 encoded characters
+ */
+namespace BinaryMapFormat {
+
+const char magic[4] = { 'T', 'M', 'B', '\0' };
+const quint16 version = 1;
+
+const int headerSize = 16;
+const int sectionEntrySize = 24;
+const int chunkEntrySize = 16;
+const int maxChunkTiles = 16 * 1024 * 1024;
+
+enum SectionType {
+    MapSection          = 1,
+    TilesetSection      = 2,
+    TileLayerSection    = 3,
+    ObjectGroupSection  = 4,
+    ImageLayerSection   = 5,
+    StringTableSection  = 6
+};
+
+enum ChunkCompression {
+    Uncompressed    = 0,
+    ZlibCompressed  = 1,
+    GzipCompressed  = 2,
+    ZstdCompressed  = 3,
+    Lz4Compressed   = 4
+};
+
+/**
+ * Returns the compression method matching the given chunk \a compression,
+ * which must not be Uncompressed.
+ */
+inline CompressionMethod compressionMethod(ChunkCompression compression)
+{
+    switch (compression) {
+    case GzipCompressed:
+        return Gzip;
+    case ZstdCompressed:
+        return Zstd;
+    case Lz4Compressed:
+        return Lz4;
+    default:
+        return Zlib;
+    }
+}
+
+} // namespace BinaryMapFormat
+} // namespace Tiled
+
+#endif // TILED_BINARYMAPFORMAT_H
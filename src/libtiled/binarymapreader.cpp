@@ -0,0 +1,841 @@
+/*
+ * binarymapreader.cpp
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "binarymapreader.h"
+
+#include "binarymapformat.h"
+#include "compression.h"
+#include "gidmapper.h"
+#include "imagecache.h"
+#include "imagelayer.h"
+#include "map.h"
+#include "mapobject.h"
+#include "mapreader.h"
+#include "maprenderer.h"
+#include "objectgroup.h"
+#include "tilelayer.h"
+#include "tileset.h"
+#include "tilesetcache.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+using namespace Tiled::BinaryMapFormat;
+
+namespace Tiled {
+namespace Internal {
+
+class BinaryMapReaderPrivate
+{
+    Q_DECLARE_TR_FUNCTIONS(BinaryMapReader)
+
+public:
+    BinaryMapReaderPrivate();
+
+    Map *readMap(const QString &fileName);
+
+    QString mError;
+    QRect mRegion;
+
+private:
+    struct Section {
+        quint32 type;
+        quint64 offset;
+        quint64 size;
+    };
+
+    struct LayerHeader {
+        QString name;
+        qint32 x;
+        qint32 y;
+        qint32 width;
+        qint32 height;
+        double opacity;
+        quint8 visible;
+        Properties properties;
+    };
+
+    Map *readMap();
+    bool readSectionTable();
+    void readStringTable(const Section &section);
+    Map *readMapSection(const Section &section);
+    void readTileset(const Section &section, Map *map);
+    LayerHeader readLayerHeader(QDataStream &stream);
+    void applyLayerHeader(Layer *layer, const LayerHeader &header);
+    TileLayer *readTileLayer(const Section &section);
+    ObjectGroup *readObjectGroup(const Section &section);
+    ImageLayer *readImageLayer(const Section &section);
+    bool isInRegion(const MapObject *object) const;
+
+    QByteArray sectionData(const Section &section) const;
+    void initStream(QDataStream &stream);
+    bool checkStream(const QDataStream &stream);
+
+    QString readString(QDataStream &stream);
+    Properties readProperties(QDataStream &stream);
+    QColor readColor(QDataStream &stream);
+    QString resolveReference(const QString &reference) const;
+    void setCorrupt();
+
+    const uchar *mData;
+    qint64 mSize;
+    QDir mMapDir;
+    QVector<Section> mSections;
+    QStringList mStrings;
+    GidMapper mGidMapper;
+    QScopedPointer<MapRenderer> mRegionRenderer;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+
+BinaryMapReaderPrivate::BinaryMapReaderPrivate()
+    : mData(0)
+    , mSize(0)
+{
+}
+
+Map *BinaryMapReaderPrivate::readMap(const QString &fileName)
+{
+    mError.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        mError = tr("Could not open file for reading.");
+        return 0;
+    }
+
+    // Mapping the file avoids copying the tile layer data. When that is not
+    // possible, the file is read into memory instead.
+    QByteArray contents;
+    mSize = file.size();
+    mData = file.map(0, mSize);
+    if (!mData) {
+        contents = file.readAll();
+        mData = reinterpret_cast<const uchar*>(contents.constData());
+        mSize = contents.size();
+    }
+
+    mMapDir = QFileInfo(fileName).absoluteDir();
+
+    Map *map = readMap();
+
+    mData = 0;
+    mSize = 0;
+    mSections.clear();
+    mStrings.clear();
+    mGidMapper.clear();
+
+    return map;
+}
+
+Map *BinaryMapReaderPrivate::readMap()
+{
+    if (mSize < headerSize || memcmp(mData, magic, sizeof(magic)) != 0) {
+        mError = tr("Not a binary map file.");
+        return 0;
+    }
+
+    const quint16 fileVersion = qFromLittleEndian<quint16>(mData + 4);
+    if (fileVersion > version) {
+        mError = tr("Unsupported binary map version: %1").arg(fileVersion);
+        return 0;
+    }
+
+    if (!readSectionTable())
+        return 0;
+
+    readStringTable(mSections.last());
+    if (!mError.isEmpty())
+        return 0;
+
+    QScopedPointer<Map> map(readMapSection(mSections.first()));
+    if (!map)
+        return 0;
+
+    // Used to find the objects within the region being read
+    if (!mRegion.isNull())
+        mRegionRenderer.reset(MapRenderer::create(map.data()));
+
+    // Unknown sections are skipped, so that later versions can add them
+    for (int i = 1; i < mSections.size() - 1 && mError.isEmpty(); ++i) {
+        const Section &section = mSections.at(i);
+        Layer *layer = 0;
+
+        switch (section.type) {
+        case TilesetSection:
+            readTileset(section, map.data());
+            break;
+        case TileLayerSection:
+            layer = readTileLayer(section);
+            break;
+        case ObjectGroupSection:
+            layer = readObjectGroup(section);
+            break;
+        case ImageLayerSection:
+            layer = readImageLayer(section);
+            break;
+        }
+
+        if (layer)
+            map->addLayer(layer);
+    }
+
+    mRegionRenderer.reset();
+
+    if (!mError.isEmpty())
+        return 0;
+
+    return map.take();
+}
+
+bool BinaryMapReaderPrivate::readSectionTable()
+{
+    const quint32 sectionCount = qFromLittleEndian<quint32>(mData + 8);
+
+    // There is always a map section and a string table
+    if (sectionCount < 2 ||
+            sectionCount > (mSize - headerSize) / sectionEntrySize) {
+        setCorrupt();
+        return false;
+    }
+
+    const uchar *entry = mData + headerSize;
+    mSections.resize(sectionCount);
+
+    for (quint32 i = 0; i < sectionCount; ++i, entry += sectionEntrySize) {
+        Section &section = mSections[i];
+        section.type = qFromLittleEndian<quint32>(entry);
+        section.offset = qFromLittleEndian<quint64>(entry + 8);
+        section.size = qFromLittleEndian<quint64>(entry + 16);
+
+        if (section.offset > quint64(mSize) ||
+                section.size > quint64(mSize) - section.offset) {
+            setCorrupt();
+            return false;
+        }
+    }
+
+    if (mSections.first().type != MapSection ||
+            mSections.last().type != StringTableSection) {
+        setCorrupt();
+        return false;
+    }
+
+    return true;
+}
+
+void BinaryMapReaderPrivate::readStringTable(const Section &section)
+{
+    const uchar *data = mData + section.offset;
+    const uchar *end = data + section.size;
+
+    if (section.size < 4) {
+        setCorrupt();
+        return;
+    }
+
+    const quint32 count = qFromLittleEndian<quint32>(data);
+    data += 4;
+
+    if (count > section.size / 4) {
+        setCorrupt();
+        return;
+    }
+
+    mStrings.reserve(count);
+
+    for (quint32 i = 0; i < count; ++i) {
+        if (end - data < 4) {
+            setCorrupt();
+            return;
+        }
+
+        const quint32 length = qFromLittleEndian<quint32>(data);
+        data += 4;
+
+        if (quint64(end - data) < length) {
+            setCorrupt();
+            return;
+        }
+
+        mStrings.append(QString::fromUtf8(reinterpret_cast<const char*>(data),
+                                          length));
+        data += length;
+    }
+}
+
+Map *BinaryMapReaderPrivate::readMapSection(const Section &section)
+{
+    const QByteArray data = sectionData(section);
+    QDataStream stream(data);
+    initStream(stream);
+
+    quint8 orientation, renderOrder, staggerAxis, staggerIndex, layerDataFormat;
+    qint32 width, height, tileWidth, tileHeight;
+    qint32 hexSideLength, compressionLevel, nextObjectId;
+
+    stream >> orientation >> renderOrder >> staggerAxis >> staggerIndex
+           >> layerDataFormat;
+    stream.skipRawData(3);
+    stream >> width >> height >> tileWidth >> tileHeight
+           >> hexSideLength >> compressionLevel >> nextObjectId;
+
+    const QColor backgroundColor = readColor(stream);
+    const Properties properties = readProperties(stream);
+
+    if (!checkStream(stream))
+        return 0;
+
+    if (orientation > Map::Hexagonal || renderOrder > Map::LeftUp ||
+            staggerAxis > Map::StaggerY || staggerIndex > Map::StaggerEven ||
+            layerDataFormat > Map::Base64Lz4 || width < 0 || height < 0) {
+        setCorrupt();
+        return 0;
+    }
+
+    Map *map = new Map(static_cast<Map::Orientation>(orientation),
+                       width, height, tileWidth, tileHeight);
+    map->setRenderOrder(static_cast<Map::RenderOrder>(renderOrder));
+    map->setStaggerAxis(static_cast<Map::StaggerAxis>(staggerAxis));
+    map->setStaggerIndex(static_cast<Map::StaggerIndex>(staggerIndex));
+    map->setLayerDataFormat(static_cast<Map::LayerDataFormat>(layerDataFormat));
+    map->setHexSideLength(hexSideLength);
+    map->setCompressionLevel(compressionLevel);
+    map->setNextObjectId(nextObjectId);
+    map->setBackgroundColor(backgroundColor);
+    map->setProperties(properties);
+
+    return map;
+}
+
+void BinaryMapReaderPrivate::readTileset(const Section &section, Map *map)
+{
+    const QByteArray data = sectionData(section);
+    QDataStream stream(data);
+    initStream(stream);
+
+    quint32 firstGid;
+    quint32 size;
+
+    stream >> firstGid;
+    const QString source = readString(stream);
+    stream >> size;
+
+    if (!checkStream(stream))
+        return;
+
+    SharedTileset tileset;
+
+    if (!source.isEmpty()) {
+        const QString fileName = resolveReference(source);
+        const bool useCache = TilesetCache::isEnabled();
+
+        if (useCache)
+            tileset = TilesetCache::find(fileName);
+
+        if (!tileset) {
+            MapReader reader;
+            tileset = reader.readTileset(fileName);
+
+            if (!tileset) {
+                mError = tr("Error while loading tileset '%1': %2")
+                        .arg(fileName, reader.errorString());
+                return;
+            }
+
+            if (useCache)
+                TilesetCache::insert(fileName, tileset);
+        }
+    } else {
+        const qint64 offset = stream.device()->pos();
+        if (size > data.size() - offset) {
+            setCorrupt();
+            return;
+        }
+
+        QByteArray tsx = QByteArray::fromRawData(data.constData() + offset,
+                                                 size);
+        QBuffer buffer(&tsx);
+        buffer.open(QIODevice::ReadOnly);
+
+        MapReader reader;
+        tileset = reader.readTileset(&buffer, mMapDir.path());
+
+        if (!tileset) {
+            mError = reader.errorString();
+            return;
+        }
+    }
+
+    map->addTileset(tileset);
+    mGidMapper.insert(firstGid, tileset.data());
+}
+
+BinaryMapReaderPrivate::LayerHeader BinaryMapReaderPrivate::readLayerHeader(QDataStream &stream)
+{
+    LayerHeader header;
+    header.name = readString(stream);
+    stream >> header.x >> header.y >> header.width >> header.height
+           >> header.opacity >> header.visible;
+    stream.skipRawData(3);
+    header.properties = readProperties(stream);
+    return header;
+}
+
+void BinaryMapReaderPrivate::applyLayerHeader(Layer *layer,
+                                              const LayerHeader &header)
+{
+    layer->setOpacity(header.opacity);
+    layer->setVisible(header.visible);
+    layer->setProperties(header.properties);
+}
+
+TileLayer *BinaryMapReaderPrivate::readTileLayer(const Section &section)
+{
+    const QByteArray data = sectionData(section);
+    QDataStream stream(data);
+    initStream(stream);
+
+    const LayerHeader header = readLayerHeader(stream);
+
+    quint8 compression;
+    quint32 chunkWidth, chunkHeight, chunkCount;
+
+    stream >> compression;
+    stream.skipRawData(3);
+    stream >> chunkWidth >> chunkHeight >> chunkCount;
+
+    if (!checkStream(stream))
+        return 0;
+
+    const int width = header.width;
+    const int height = header.height;
+
+    if (width < 0 || height < 0 || chunkWidth == 0 || chunkHeight == 0 ||
+            compression > Lz4Compressed) {
+        setCorrupt();
+        return 0;
+    }
+
+    // Chunks larger than the layer only cover the layer. A larger chunk size
+    // also can't be used for the allocations below.
+    chunkWidth = qMin<quint32>(chunkWidth, qMax(1, width));
+    chunkHeight = qMin<quint32>(chunkHeight, qMax(1, height));
+
+    if (quint64(chunkWidth) * chunkHeight > quint64(maxChunkTiles)) {
+        setCorrupt();
+        return 0;
+    }
+
+    if (compression != Uncompressed &&
+            !compressionSupported(compressionMethod(ChunkCompression(compression)))) {
+        mError = tr("Compression method of layer '%1' not supported")
+                .arg(header.name);
+        return 0;
+    }
+
+    const quint64 columns = (quint64(width) + chunkWidth - 1) / chunkWidth;
+    const quint64 rows = (quint64(height) + chunkHeight - 1) / chunkHeight;
+
+    if (chunkCount != columns * rows) {
+        setCorrupt();
+        return 0;
+    }
+
+    // When only a region of the map is read, the layer only covers the part
+    // of the layer data within that region
+    const QRect dataBounds(header.x, header.y, width, height);
+    QRect bounds = dataBounds;
+    if (!mRegion.isNull()) {
+        bounds &= mRegion;
+        if (bounds.isEmpty())
+            bounds = QRect(mRegion.topLeft(), QSize(0, 0));
+    }
+
+    QScopedPointer<TileLayer> tileLayer(new TileLayer(header.name,
+                                                      bounds.x(), bounds.y(),
+                                                      bounds.width(),
+                                                      bounds.height()));
+    applyLayerHeader(tileLayer.data(), header);
+
+    const QPoint dataOffset = dataBounds.topLeft() - bounds.topLeft();
+    const QRect layerRect(0, 0, bounds.width(), bounds.height());
+
+    const QString corruptLayerData =
+            tr("Corrupt layer data for layer '%1'").arg(header.name);
+
+    QVector<Cell> cells(int(chunkWidth));
+    QByteArray decompressed;
+
+    for (quint32 i = 0; i < chunkCount; ++i) {
+        quint64 offset;
+        quint32 size;
+
+        stream >> offset >> size;
+        stream.skipRawData(4);
+
+        if (!checkStream(stream))
+            return 0;
+
+        // Chunks without tiles have no data
+        if (size == 0)
+            continue;
+
+        if (offset > section.size || size > section.size - offset) {
+            mError = corruptLayerData;
+            return 0;
+        }
+
+        const int left = int(i % columns * chunkWidth);
+        const int top = int(i / columns * chunkHeight);
+        const int right = int(qMin<quint64>(left + quint64(chunkWidth), width));
+        const int bottom = int(qMin<quint64>(top + quint64(chunkHeight), height));
+
+        // Can't overflow, since chunks have at most maxChunkTiles cells
+        const int expectedSize = (right - left) * (bottom - top) * 4;
+
+        // Chunks outside of the region being read are skipped, and of the
+        // others only the part within the region is looked at
+        const QRect area = QRect(left, top, right - left, bottom - top)
+                .translated(dataOffset) & layerRect;
+        if (area.isEmpty())
+            continue;
+
+        const uchar *gids = mData + section.offset + offset;
+
+        if (compression != Uncompressed) {
+            const ChunkCompression chunkCompression =
+                    static_cast<ChunkCompression>(compression);
+
+            decompressed = decompress(QByteArray::fromRawData(reinterpret_cast<const char*>(gids), size),
+                                      expectedSize,
+                                      compressionMethod(chunkCompression));
+
+            gids = reinterpret_cast<const uchar*>(decompressed.constData());
+            size = decompressed.size();
+        }
+
+        if (size != quint32(expectedSize)) {
+            mError = corruptLayerData;
+            return 0;
+        }
+
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            const int row = y - dataOffset.y() - top;
+            const int column = area.x() - dataOffset.x() - left;
+            const uchar *rowGids = gids + (row * (right - left) + column) * 4;
+
+            for (int x = 0; x < area.width(); ++x) {
+                const unsigned gid = qFromLittleEndian<quint32>(rowGids);
+                rowGids += 4;
+
+                bool ok;
+                cells[x] = mGidMapper.gidToCell(gid, ok);
+
+                if (!ok) {
+                    if (mGidMapper.isEmpty())
+                        mError = tr("Tile used but no tilesets specified");
+                    else
+                        mError = tr("Invalid tile: %1").arg(gid);
+                    return 0;
+                }
+            }
+
+            tileLayer->setCells(area.x(), y, area.width(), cells.constData());
+        }
+    }
+
+    return tileLayer.take();
+}
+
+ObjectGroup *BinaryMapReaderPrivate::readObjectGroup(const Section &section)
+{
+    const QByteArray data = sectionData(section);
+    QDataStream stream(data);
+    initStream(stream);
+
+    const LayerHeader header = readLayerHeader(stream);
+    const QColor color = readColor(stream);
+
+    quint8 drawOrder;
+    quint32 objectCount;
+
+    stream >> drawOrder;
+    stream.skipRawData(3);
+    stream >> objectCount;
+
+    if (!checkStream(stream))
+        return 0;
+
+    if (drawOrder > ObjectGroup::IndexOrder) {
+        setCorrupt();
+        return 0;
+    }
+
+    QScopedPointer<ObjectGroup> objectGroup(new ObjectGroup(header.name,
+                                                            header.x, header.y,
+                                                            header.width,
+                                                            header.height));
+    applyLayerHeader(objectGroup.data(), header);
+    objectGroup->setColor(color);
+    objectGroup->setDrawOrder(static_cast<ObjectGroup::DrawOrder>(drawOrder));
+
+    for (quint32 i = 0; i < objectCount; ++i) {
+        qint32 id;
+        quint32 gid;
+        double x, y, width, height, rotation;
+        quint8 shape, visible;
+        quint32 pointCount;
+
+        stream >> id;
+        const QString name = readString(stream);
+        const QString type = readString(stream);
+        stream >> gid >> x >> y >> width >> height >> rotation
+               >> shape >> visible;
+        stream.skipRawData(2);
+        stream >> pointCount;
+
+        // Each point takes 16 bytes
+        if (!checkStream(stream) || shape > MapObject::Ellipse ||
+                pointCount > quint32(data.size()) / 16) {
+            setCorrupt();
+            return 0;
+        }
+
+        QPolygonF polygon;
+        polygon.reserve(pointCount);
+        for (quint32 j = 0; j < pointCount; ++j) {
+            double pointX, pointY;
+            stream >> pointX >> pointY;
+            polygon.append(QPointF(pointX, pointY));
+        }
+
+        const Properties properties = readProperties(stream);
+
+        if (!checkStream(stream))
+            return 0;
+
+        MapObject *object = new MapObject(name, type,
+                                          QPointF(x, y),
+                                          QSizeF(width, height));
+        object->setId(id);
+        object->setRotation(rotation);
+        object->setShape(static_cast<MapObject::Shape>(shape));
+        object->setVisible(visible);
+        object->setPolygon(polygon);
+        object->setProperties(properties);
+
+        if (gid) {
+            bool ok;
+            object->setCell(mGidMapper.gidToCell(gid, ok));
+            if (!ok) {
+                delete object;
+                mError = tr("Invalid tile: %1").arg(gid);
+                return 0;
+            }
+        }
+
+        if (isInRegion(object))
+            objectGroup->addObject(object);
+        else
+            delete object;
+    }
+
+    return objectGroup.take();
+}
+
+/**
+ * Returns whether the \a object intersects the region of the map being read.
+ * Always true when the whole map is read.
+ */
+bool BinaryMapReaderPrivate::isInRegion(const MapObject *object) const
+{
+    if (!mRegionRenderer)
+        return true;
+
+    const QRectF regionBounds = mRegionRenderer->boundingRect(mRegion);
+    return mRegionRenderer->boundingRect(object).intersects(regionBounds);
+}
+
+ImageLayer *BinaryMapReaderPrivate::readImageLayer(const Section &section)
+{
+    const QByteArray data = sectionData(section);
+    QDataStream stream(data);
+    initStream(stream);
+
+    const LayerHeader header = readLayerHeader(stream);
+    const QString source = readString(stream);
+    const QColor transparentColor = readColor(stream);
+
+    if (!checkStream(stream))
+        return 0;
+
+    QScopedPointer<ImageLayer> imageLayer(new ImageLayer(header.name,
+                                                         header.x, header.y,
+                                                         header.width,
+                                                         header.height));
+    applyLayerHeader(imageLayer.data(), header);
+    imageLayer->setTransparentColor(transparentColor);
+
+    if (!source.isEmpty()) {
+        const QString fileName = resolveReference(source);
+        const QImage image = ImageCache::loadImage(fileName);
+
+        if (!imageLayer->loadFromImage(image, fileName)) {
+            mError = tr("Error loading image layer image:\n'%1'").arg(fileName);
+            return 0;
+        }
+    }
+
+    return imageLayer.take();
+}
+
+/**
+ * Returns the data of the given \a section without copying it.
+ */
+QByteArray BinaryMapReaderPrivate::sectionData(const Section &section) const
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(mData + section.offset),
+                                   int(section.size));
+}
+
+void BinaryMapReaderPrivate::initStream(QDataStream &stream)
+{
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+/**
+ * Returns whether the \a stream is still fine, setting the error otherwise.
+ * Also returns false when an error was set while reading from the stream.
+ */
+bool BinaryMapReaderPrivate::checkStream(const QDataStream &stream)
+{
+    if (stream.status() != QDataStream::Ok)
+        setCorrupt();
+
+    return mError.isEmpty();
+}
+
+QString BinaryMapReaderPrivate::readString(QDataStream &stream)
+{
+    quint32 index = 0;
+    stream >> index;
+
+    if (index >= quint32(mStrings.size())) {
+        setCorrupt();
+        return QString();
+    }
+
+    return mStrings.at(index);
+}
+
+Properties BinaryMapReaderPrivate::readProperties(QDataStream &stream)
+{
+    Properties properties;
+
+    quint32 count = 0;
+    stream >> count;
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        const QString name = readString(stream);
+        const QString value = readString(stream);
+        properties.insert(name, value);
+    }
+
+    return properties;
+}
+
+QColor BinaryMapReaderPrivate::readColor(QDataStream &stream)
+{
+    quint32 rgba = 0;
+    stream >> rgba;
+
+    if (rgba == 0)
+        return QColor();
+
+    return QColor::fromRgba(rgba);
+}
+
+QString BinaryMapReaderPrivate::resolveReference(const QString &reference) const
+{
+    if (QDir::isRelativePath(reference))
+        return QDir::cleanPath(mMapDir.filePath(reference));
+    return reference;
+}
+
+void BinaryMapReaderPrivate::setCorrupt()
+{
+    if (mError.isEmpty())
+        mError = tr("The binary map file is corrupt.");
+}
+
+
+BinaryMapReader::BinaryMapReader()
+    : d(new BinaryMapReaderPrivate)
+{
+}
+
+BinaryMapReader::~BinaryMapReader()
+{
+    delete d;
+}
+
+Map *BinaryMapReader::readMap(const QString &fileName)
+{
+    return d->readMap(fileName);
+}
+
+QString BinaryMapReader::errorString() const
+{
+    return d->mError;
+}
+
+void BinaryMapReader::setRegion(const QRect &region)
+{
+    d->mRegion = region;
+}
+
+QRect BinaryMapReader::region() const
+{
+    return d->mRegion;
+}
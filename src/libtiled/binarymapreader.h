@@ -0,0 +1,86 @@
+/*
+ * binarymapreader.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILED_BINARYMAPREADER_H
+#define TILED_BINARYMAPREADER_H
+
+#include "tiled_global.h"
+
+#include <QRect>
+#include <QString>
+
+namespace Tiled {
+
+class Map;
+
+namespace Internal {
+class BinaryMapReaderPrivate;
+}
+
+/**
+ * Reads maps in the binary map format described in binarymapformat.h.
+ *
+ * The file is memory mapped when possible, so that uncompressed tile layer
+ * data is translated to cells straight from the mapping, without parsing or
+ * copying it first.
+ */
+class TILEDSHARED_EXPORT BinaryMapReader
+{
+public:
+    BinaryMapReader();
+    ~BinaryMapReader();
+
+    /**
+     * Reads a map from the given \a fileName.
+     *
+     * Returns 0 and sets errorString() when reading failed.
+     *
+     * The caller takes ownership over the newly created map.
+     */
+    Map *readMap(const QString &fileName);
+
+    /**
+     * Returns the error message for the last occurred error.
+     */
+    QString errorString() const;
+
+    /**
+     * Sets the \a region of the map, in tiles, that is read. Works like
+     * MapReader::setRegion(), with chunks outside of the region not being
+     * read at all.
+     */
+    void setRegion(const QRect &region);
+    QRect region() const;
+
+private:
+    Internal::BinaryMapReaderPrivate *d;
+};
+
+} // namespace Tiled
+
+#endif // TILED_BINARYMAPREADER_H
@@ -0,0 +1,537 @@
+/*
+ * binarymapwriter.cpp
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "binarymapwriter.h"
+
+#include "binarymapformat.h"
+#include "compression.h"
+#include "gidmapper.h"
+#include "imagelayer.h"
+#include "map.h"
+#include "mapobject.h"
+#include "mapwriter.h"
+#include "objectgroup.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+using namespace Tiled::BinaryMapFormat;
+
+namespace Tiled {
+namespace Internal {
+
+class BinaryMapWriterPrivate
+{
+    Q_DECLARE_TR_FUNCTIONS(BinaryMapWriter)
+
+public:
+    BinaryMapWriterPrivate();
+
+    bool writeMap(const Map *map, const QString &fileName);
+
+    QString mError;
+    QSize mChunkSize;
+
+private:
+    struct Section {
+        quint32 type;
+        quint64 offset;
+        quint64 size;
+    };
+
+    void beginSection(SectionType type);
+    void endSection();
+
+    void writeMapSection(const Map *map);
+    void writeTileset(const Tileset *tileset, unsigned firstGid);
+    void writeLayerHeader(const Layer *layer);
+    void writeTileLayer(const TileLayer *tileLayer);
+    void writeObjectGroup(const ObjectGroup *objectGroup);
+    void writeImageLayer(const ImageLayer *imageLayer);
+    void writeStringTable();
+
+    void writeProperties(const Properties &properties);
+    void writeString(const QString &string);
+    void writeColor(const QColor &color);
+    void writePadding(int alignment);
+    void writeZeros(qint64 count);
+
+    QFileDevice *mFile;
+    QDataStream mStream;
+    QVector<Section> mSections;
+    QHash<QString, quint32> mStringIndexes;
+    QStringList mStrings;
+    QDir mMapDir;
+    GidMapper mGidMapper;
+    ChunkCompression mCompression;
+    int mCompressionLevel;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+
+BinaryMapWriterPrivate::BinaryMapWriterPrivate()
+    : mChunkSize(64, 64)
+    , mFile(0)
+    , mCompression(Uncompressed)
+    , mCompressionLevel(-1)
+{
+    mStream.setByteOrder(QDataStream::LittleEndian);
+    mStream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+bool BinaryMapWriterPrivate::writeMap(const Map *map, const QString &fileName)
+{
+    // Lazily loaded layers that failed to decode would be written empty
+    const QString decodeError = const_cast<Map*>(map)->decodeLayerData();
+    if (!decodeError.isEmpty()) {
+        mError = decodeError;
+        return false;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        mError = tr("Could not open file for writing.");
+        return false;
+    }
+
+    mError.clear();
+    mFile = &file;
+    mStream.setDevice(&file);
+    mSections.clear();
+    mStringIndexes.clear();
+    mStrings.clear();
+    mGidMapper.clear();
+    mMapDir = QFileInfo(fileName).absoluteDir();
+
+    // The empty string always has index 0
+    mStrings.append(QString());
+    mStringIndexes.insert(QString(), 0);
+
+    switch (map->layerDataFormat()) {
+    case Map::Base64Gzip:
+        mCompression = GzipCompressed;
+        break;
+    case Map::Base64Zlib:
+        mCompression = ZlibCompressed;
+        break;
+    case Map::Base64Zstd:
+        mCompression = ZstdCompressed;
+        break;
+    case Map::Base64Lz4:
+        mCompression = Lz4Compressed;
+        break;
+    default:
+        mCompression = Uncompressed;
+        break;
+    }
+    mCompressionLevel = map->compressionLevel();
+
+    const int sectionCount = map->tilesetCount() + map->layerCount() + 2;
+
+    // The section table is written at the end, when the offsets and sizes of
+    // the sections are known
+    mStream.writeRawData(magic, sizeof(magic));
+    mStream << version << quint16(0) << quint32(sectionCount) << quint32(0);
+    writeZeros(sectionCount * sectionEntrySize);
+
+    writeMapSection(map);
+
+    unsigned firstGid = 1;
+    foreach (const SharedTileset &tileset, map->tilesets()) {
+        writeTileset(tileset.data(), firstGid);
+        mGidMapper.insert(firstGid, tileset.data());
+        firstGid += tileset->tileCount();
+    }
+
+    foreach (const Layer *layer, map->layers()) {
+        switch (layer->layerType()) {
+        case Layer::TileLayerType:
+            writeTileLayer(static_cast<const TileLayer*>(layer));
+            break;
+        case Layer::ObjectGroupType:
+            writeObjectGroup(static_cast<const ObjectGroup*>(layer));
+            break;
+        case Layer::ImageLayerType:
+            writeImageLayer(static_cast<const ImageLayer*>(layer));
+            break;
+        }
+    }
+
+    writeStringTable();
+
+    Q_ASSERT(mSections.size() == sectionCount);
+
+    file.seek(headerSize);
+    foreach (const Section &section, mSections)
+        mStream << section.type << quint32(0) << section.offset << section.size;
+
+    mStream.setDevice(0);
+    mFile = 0;
+
+    if (!mError.isEmpty())
+        return false;
+
+    if (file.error() != QFile::NoError) {
+        mError = file.errorString();
+        return false;
+    }
+
+    if (!file.commit()) {
+        mError = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void BinaryMapWriterPrivate::beginSection(SectionType type)
+{
+    writePadding(8);
+
+    Section section;
+    section.type = type;
+    section.offset = mFile->pos();
+    section.size = 0;
+    mSections.append(section);
+}
+
+void BinaryMapWriterPrivate::endSection()
+{
+    Section &section = mSections.last();
+    section.size = mFile->pos() - section.offset;
+}
+
+void BinaryMapWriterPrivate::writeMapSection(const Map *map)
+{
+    beginSection(MapSection);
+
+    mStream << quint8(map->orientation())
+            << quint8(map->renderOrder())
+            << quint8(map->staggerAxis())
+            << quint8(map->staggerIndex())
+            << quint8(map->layerDataFormat());
+    writeZeros(3);
+
+    mStream << qint32(map->width())
+            << qint32(map->height())
+            << qint32(map->tileWidth())
+            << qint32(map->tileHeight())
+            << qint32(map->hexSideLength())
+            << qint32(map->compressionLevel())
+            << qint32(map->nextObjectId());
+
+    writeColor(map->backgroundColor());
+    writeProperties(map->properties());
+
+    endSection();
+}
+
+void BinaryMapWriterPrivate::writeTileset(const Tileset *tileset,
+                                          unsigned firstGid)
+{
+    beginSection(TilesetSection);
+
+    mStream << quint32(firstGid);
+
+    if (!tileset->fileName().isEmpty()) {
+        writeString(mMapDir.relativeFilePath(tileset->fileName()));
+        mStream << quint32(0);
+    } else {
+        // Embedded tilesets are stored in the TSX format, since they are
+        // small and rarely the reason a map is slow to load
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+
+        MapWriter writer;
+        if (!writer.writeTileset(*tileset, &buffer, mMapDir.path()) &&
+                mError.isEmpty()) {
+            mError = writer.errorString();
+        }
+
+        writeString(QString());
+        mStream << quint32(buffer.data().size());
+        mStream.writeRawData(buffer.data().constData(), buffer.data().size());
+    }
+
+    endSection();
+}
+
+void BinaryMapWriterPrivate::writeLayerHeader(const Layer *layer)
+{
+    writeString(layer->name());
+    mStream << qint32(layer->x())
+            << qint32(layer->y())
+            << qint32(layer->width())
+            << qint32(layer->height())
+            << double(layer->opacity())
+            << quint8(layer->isVisible());
+    writeZeros(3);
+    writeProperties(layer->properties());
+}
+
+void BinaryMapWriterPrivate::writeTileLayer(const TileLayer *tileLayer)
+{
+    beginSection(TileLayerSection);
+    const qint64 sectionOffset = mFile->pos();
+
+    writeLayerHeader(tileLayer);
+
+    const int width = tileLayer->width();
+    const int height = tileLayer->height();
+    int chunkWidth = mChunkSize.isEmpty() ? width : mChunkSize.width();
+    int chunkHeight = mChunkSize.isEmpty() ? height : mChunkSize.height();
+
+    // Keep the chunks within the layer and within the size readers accept
+    chunkWidth = qBound(1, chunkWidth, qMin(qMax(1, width), maxChunkTiles));
+    chunkHeight = qBound(1, chunkHeight, qMax(1, height));
+    chunkHeight = qMin(chunkHeight, maxChunkTiles / chunkWidth);
+
+    const int columns = (width + chunkWidth - 1) / chunkWidth;
+    const int rows = (height + chunkHeight - 1) / chunkHeight;
+    const int chunkCount = columns * rows;
+
+    mStream << quint8(mCompression);
+    writeZeros(3);
+    mStream << quint32(chunkWidth) << quint32(chunkHeight) << quint32(chunkCount);
+
+    // The chunk table is filled in after writing the chunks
+    const qint64 chunkTableOffset = mFile->pos();
+    writeZeros(qint64(chunkCount) * chunkEntrySize);
+
+    QVector<quint64> chunkOffsets(chunkCount);
+    QVector<quint32> chunkSizes(chunkCount);
+    QByteArray gids;
+
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            const int chunkIndex = column + row * columns;
+            const int left = column * chunkWidth;
+            const int top = row * chunkHeight;
+            const int right = qMin(left + chunkWidth, width);
+            const int bottom = qMin(top + chunkHeight, height);
+
+            gids.resize((right - left) * (bottom - top) * 4);
+            uchar *out = reinterpret_cast<uchar*>(gids.data());
+            bool empty = true;
+
+            for (int y = top; y < bottom; ++y) {
+                for (int x = left; x < right; ++x) {
+                    const unsigned gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
+                    qToLittleEndian<quint32>(gid, out);
+                    out += 4;
+                    empty &= gid == 0;
+                }
+            }
+
+            // Chunks without tiles have no data
+            if (empty)
+                continue;
+
+            QByteArray data = gids;
+            if (mCompression != Uncompressed) {
+                data = compress(gids, compressionMethod(mCompression),
+                                mCompressionLevel);
+                if (data.isNull())
+                    mError = tr("Failed to compress tile layer data.");
+            }
+
+            writePadding(4);
+            chunkOffsets[chunkIndex] = mFile->pos() - sectionOffset;
+            chunkSizes[chunkIndex] = data.size();
+            mStream.writeRawData(data.constData(), data.size());
+        }
+    }
+
+    const qint64 end = mFile->pos();
+    mFile->seek(chunkTableOffset);
+    for (int i = 0; i < chunkCount; ++i)
+        mStream << chunkOffsets.at(i) << chunkSizes.at(i) << quint32(0);
+    mFile->seek(end);
+
+    endSection();
+}
+
+void BinaryMapWriterPrivate::writeObjectGroup(const ObjectGroup *objectGroup)
+{
+    beginSection(ObjectGroupSection);
+
+    writeLayerHeader(objectGroup);
+    writeColor(objectGroup->color());
+    mStream << quint8(objectGroup->drawOrder());
+    writeZeros(3);
+
+    mStream << quint32(objectGroup->objectCount());
+
+    foreach (const MapObject *mapObject, objectGroup->objects()) {
+        mStream << qint32(mapObject->id());
+        writeString(mapObject->name());
+        writeString(mapObject->type());
+        mStream << quint32(mGidMapper.cellToGid(mapObject->cell()))
+                << double(mapObject->x())
+                << double(mapObject->y())
+                << double(mapObject->width())
+                << double(mapObject->height())
+                << double(mapObject->rotation())
+                << quint8(mapObject->shape())
+                << quint8(mapObject->isVisible());
+        writeZeros(2);
+
+        const QPolygonF &polygon = mapObject->polygon();
+        mStream << quint32(polygon.size());
+        foreach (const QPointF &point, polygon)
+            mStream << double(point.x()) << double(point.y());
+
+        writeProperties(mapObject->properties());
+    }
+
+    endSection();
+}
+
+void BinaryMapWriterPrivate::writeImageLayer(const ImageLayer *imageLayer)
+{
+    beginSection(ImageLayerSection);
+
+    writeLayerHeader(imageLayer);
+
+    const QString &source = imageLayer->imageSource();
+    writeString(source.isEmpty() ? source : mMapDir.relativeFilePath(source));
+    writeColor(imageLayer->transparentColor());
+
+    endSection();
+}
+
+void BinaryMapWriterPrivate::writeStringTable()
+{
+    beginSection(StringTableSection);
+
+    mStream << quint32(mStrings.size());
+    foreach (const QString &string, mStrings) {
+        const QByteArray utf8 = string.toUtf8();
+        mStream << quint32(utf8.size());
+        mStream.writeRawData(utf8.constData(), utf8.size());
+    }
+
+    endSection();
+}
+
+void BinaryMapWriterPrivate::writeProperties(const Properties &properties)
+{
+    mStream << quint32(properties.size());
+
+    Properties::const_iterator it = properties.constBegin();
+    Properties::const_iterator it_end = properties.constEnd();
+    for (; it != it_end; ++it) {
+        writeString(it.key());
+        writeString(it.value());
+    }
+}
+
+void BinaryMapWriterPrivate::writeString(const QString &string)
+{
+    QHash<QString, quint32>::const_iterator it = mStringIndexes.find(string);
+    if (it != mStringIndexes.constEnd()) {
+        mStream << it.value();
+        return;
+    }
+
+    const quint32 index = mStrings.size();
+    mStrings.append(string);
+    mStringIndexes.insert(string, index);
+    mStream << index;
+}
+
+void BinaryMapWriterPrivate::writeColor(const QColor &color)
+{
+    mStream << quint32(color.isValid() ? color.rgba() : 0);
+}
+
+/**
+ * Writes zeros until the file position is a multiple of \a alignment.
+ */
+void BinaryMapWriterPrivate::writePadding(int alignment)
+{
+    const qint64 remainder = mFile->pos() % alignment;
+    if (remainder != 0)
+        writeZeros(alignment - remainder);
+}
+
+void BinaryMapWriterPrivate::writeZeros(qint64 count)
+{
+    static const char zeros[256] = {};
+
+    while (count > 0) {
+        const int length = int(qMin<qint64>(count, sizeof(zeros)));
+        mStream.writeRawData(zeros, length);
+        count -= length;
+    }
+}
+
+
+BinaryMapWriter::BinaryMapWriter()
+    : d(new BinaryMapWriterPrivate)
+{
+}
+
+BinaryMapWriter::~BinaryMapWriter()
+{
+    delete d;
+}
+
+bool BinaryMapWriter::writeMap(const Map *map, const QString &fileName)
+{
+    return d->writeMap(map, fileName);
+}
+
+void BinaryMapWriter::setChunkSize(const QSize &size)
+{
+    d->mChunkSize = size;
+}
+
+QSize BinaryMapWriter::chunkSize() const
+{
+    return d->mChunkSize;
+}
+
+QString BinaryMapWriter::errorString() const
+{
+    return d->mError;
+}
@@ -0,0 +1,86 @@
+/*
+ * binarymapwriter.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILED_BINARYMAPWRITER_H
+#define TILED_BINARYMAPWRITER_H
+
+#include "tiled_global.h"
+
+#include <QSize>
+#include <QString>
+
+namespace Tiled {
+
+class Map;
+
+namespace Internal {
+class BinaryMapWriterPrivate;
+}
+
+/**
+ * Writes maps in the binary map format described in binarymapformat.h.
+ *
+ * The tile layer data is compressed when the layer data format of the map
+ * uses compression. Otherwise it is stored uncompressed, which is the
+ * fastest to load.
+ */
+class TILEDSHARED_EXPORT BinaryMapWriter
+{
+public:
+    BinaryMapWriter();
+    ~BinaryMapWriter();
+
+    /**
+     * Writes the given \a map to \a fileName.
+     *
+     * Returns false and sets errorString() when writing failed.
+     */
+    bool writeMap(const Map *map, const QString &fileName);
+
+    /**
+     * Sets the size of the chunks tile layers are divided into. Each chunk
+     * is compressed on its own, and chunks without tiles are left out. An
+     * empty size stores each layer as a single chunk.
+     *
+     * The default is 64 by 64 tiles.
+     */
+    void setChunkSize(const QSize &size);
+    QSize chunkSize() const;
+
+    /**
+     * Returns the error message for the last occurred error.
+     */
+    QString errorString() const;
+
+private:
+    Internal::BinaryMapWriterPrivate *d;
+};
+
+} // namespace Tiled
+
+#endif // TILED_BINARYMAPWRITER_H
@@ -34,9 +34,19 @@
 #include <zlib.h>
 #endif
 
+#ifdef TILED_LZ4_SUPPORT
+#include <lz4frame.h>
+#include <lz4hc.h>
+#endif
+#ifdef TILED_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
 #include <QByteArray>
 #include <QDebug>
 
+#include <cstring>
+
 #ifdef Z_PREFIX
 #undef compress
 #endif
@@ -63,99 +73,161 @@ static void logZlibError(int error)
     }
 }
 
-QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
+static void logUnsupported(CompressionMethod method)
 {
-    QByteArray out;
-    out.resize(expectedSize);
-    z_stream strm;
+    qDebug() << "Compression method" << method
+             << "is not supported by this build!";
+}
 
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.next_in = (Bytef *) data.data();
-    strm.avail_in = data.length();
-    strm.next_out = (Bytef *) out.data();
-    strm.avail_out = out.size();
+#ifdef TILED_ZSTD_SUPPORT
+static void logZstdError(size_t error)
+{
+    qDebug() << "Error while (de)compressing Zstandard data:"
+             << ZSTD_getErrorName(error);
+}
+#endif
 
-    int ret = inflateInit2(&strm, 15 + 32);
+#ifdef TILED_LZ4_SUPPORT
+static void logLz4Error(size_t error)
+{
+    qDebug() << "Error while (de)compressing LZ4 data:"
+             << LZ4F_getErrorName(error);
+}
+#endif
 
-    if (ret != Z_OK) {
-        logZlibError(ret);
-        return QByteArray();
+static int zlibLevel(int level)
+{
+    if (level == -1)
+        return Z_DEFAULT_COMPRESSION;
+    return qBound(Z_NO_COMPRESSION, level, Z_BEST_COMPRESSION);
+}
+
+#ifdef TILED_ZSTD_SUPPORT
+static int zstdLevel(int level)
+{
+    if (level == -1)
+        return ZSTD_CLEVEL_DEFAULT;
+    return qBound(1, level, ZSTD_maxCLevel());
+}
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+static void initLz4Preferences(LZ4F_preferences_t &preferences, int level)
+{
+    memset(&preferences, 0, sizeof(preferences));
+    if (level != -1)
+        preferences.compressionLevel = qBound(0, level, LZ4HC_CLEVEL_MAX);
+}
+#endif
+
+bool Tiled::compressionSupported(CompressionMethod method)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        return true;
+    case Zstd:
+#ifdef TILED_ZSTD_SUPPORT
+        return true;
+#else
+        return false;
+#endif
+    case Lz4:
+#ifdef TILED_LZ4_SUPPORT
+        return true;
+#else
+        return false;
+#endif
     }
 
-    do {
-        ret = inflate(&strm, Z_SYNC_FLUSH);
-
-        switch (ret) {
-            case Z_NEED_DICT:
-            case Z_STREAM_ERROR:
-                ret = Z_DATA_ERROR;
-            case Z_DATA_ERROR:
-            case Z_MEM_ERROR:
-                inflateEnd(&strm);
-                logZlibError(ret);
-                return QByteArray();
-        }
+    return false;
+}
+
+/**
+ * Grows \a out by \a space bytes and returns a pointer to the added space.
+ * The caller chops off what was not used.
+ */
+static char *growOutput(QByteArray &out, int space)
+{
+    const int size = out.size();
+    out.resize(size + space);
+    return out.data() + size;
+}
 
-        if (ret != Z_STREAM_END) {
-            int oldSize = out.size();
+QByteArray Tiled::decompress(const QByteArray &data,
+                             int expectedSize,
+                             CompressionMethod method)
+{
+    Decompressor decompressor(method);
+    decompressor.setInput(data.constData(), data.size());
+
+    QByteArray out;
+    out.resize(qMax(expectedSize, 1));
+    int outLength = 0;
+
+    while (!decompressor.atEnd()) {
+        if (outLength == out.size())
             out.resize(out.size() * 2);
 
-            strm.next_out = (Bytef *)(out.data() + oldSize);
-            strm.avail_out = oldSize;
+        const int space = out.size() - outLength;
+        const int written = decompressor.decompress(out.data() + outLength,
+                                                    space);
+        if (written < 0)
+            return QByteArray();
+
+        outLength += written;
+
+        // Truncated data
+        if (written < space && decompressor.remainingInput() == 0 &&
+                !decompressor.atEnd()) {
+            qDebug() << "Compressed data ended unexpectedly!";
+            return QByteArray();
         }
     }
-    while (ret != Z_STREAM_END);
 
-    if (strm.avail_in != 0) {
-        logZlibError(Z_DATA_ERROR);
+    if (decompressor.remainingInput() != 0) {
+        qDebug() << "Unexpected data after compressed data!";
         return QByteArray();
     }
 
-    const int outLength = out.size() - strm.avail_out;
-    inflateEnd(&strm);
-
     out.resize(outLength);
     return out;
 }
 
-QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
+static QByteArray compressZlib(const QByteArray &data, CompressionMethod method,
+                               int level)
 {
-    QByteArray out;
-    out.resize(1024);
     int err;
     z_stream strm;
     strm.zalloc = Z_NULL;
     strm.zfree = Z_NULL;
     strm.opaque = Z_NULL;
-    strm.next_in = (Bytef *) data.data();
-    strm.avail_in = data.length();
-    strm.next_out = (Bytef *) out.data();
-    strm.avail_out = out.size();
 
     const int windowBits = (method == Gzip) ? 15 + 16 : 15;
 
-    err = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits,
+    err = deflateInit2(&strm, zlibLevel(level), Z_DEFLATED, windowBits,
                        8, Z_DEFAULT_STRATEGY);
     if (err != Z_OK) {
         logZlibError(err);
         return QByteArray();
     }
 
-    do {
-        err = deflate(&strm, Z_FINISH);
-        Q_ASSERT(err != Z_STREAM_ERROR);
+    // Versions of zlib before 1.2.5.1 leave out the gzip header and trailer
+    uLong bound = deflateBound(&strm, data.length());
+    if (method == Gzip)
+        bound += 18;
 
-        if (err == Z_OK) {
-            // More output space needed
-            int oldSize = out.size();
-            out.resize(out.size() * 2);
+    QByteArray out;
+    out.resize(int(bound));
 
-            strm.next_out = (Bytef *)(out.data() + oldSize);
-            strm.avail_out = oldSize;
-        }
-    } while (err == Z_OK);
+    strm.next_in = (Bytef *) data.data();
+    strm.avail_in = data.length();
+    strm.next_out = (Bytef *) out.data();
+    strm.avail_out = out.size();
+
+    // With enough output space, a single call finishes the stream
+    err = deflate(&strm, Z_FINISH);
+    Q_ASSERT(err != Z_STREAM_ERROR);
 
     if (err != Z_STREAM_END) {
         logZlibError(err);
@@ -169,3 +241,635 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     out.resize(outLength);
     return out;
 }
+
+#ifdef TILED_ZSTD_SUPPORT
+static QByteArray compressZstd(const QByteArray &data, int level)
+{
+    QByteArray out;
+    out.resize(int(ZSTD_compressBound(data.size())));
+
+    const size_t outLength = ZSTD_compress(out.data(), out.size(),
+                                           data.constData(), data.size(),
+                                           zstdLevel(level));
+    if (ZSTD_isError(outLength)) {
+        logZstdError(outLength);
+        return QByteArray();
+    }
+
+    out.resize(int(outLength));
+    return out;
+}
+
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+static QByteArray compressLz4(const QByteArray &data, int level)
+{
+    LZ4F_preferences_t preferences;
+    initLz4Preferences(preferences, level);
+
+    QByteArray out;
+    out.resize(int(LZ4F_compressFrameBound(data.size(), &preferences)));
+
+    const size_t outLength = LZ4F_compressFrame(out.data(), out.size(),
+                                                data.constData(), data.size(),
+                                                &preferences);
+    if (LZ4F_isError(outLength)) {
+        logLz4Error(outLength);
+        return QByteArray();
+    }
+
+    out.resize(int(outLength));
+    return out;
+}
+#endif
+
+QByteArray Tiled::compress(const QByteArray &data,
+                           CompressionMethod method,
+                           int level)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        return compressZlib(data, method, level);
+    case Zstd:
+#ifdef TILED_ZSTD_SUPPORT
+        return compressZstd(data, level);
+#else
+        break;
+#endif
+    case Lz4:
+#ifdef TILED_LZ4_SUPPORT
+        return compressLz4(data, level);
+#else
+        break;
+#endif
+    }
+
+    logUnsupported(method);
+    return QByteArray();
+}
+
+
+namespace Tiled {
+
+class CompressorPrivate
+{
+public:
+    CompressionMethod method;
+    bool initialized;
+    bool error;
+
+    // Zlib and gzip
+    z_stream strm;
+
+#ifdef TILED_ZSTD_SUPPORT
+    ZSTD_CStream *zstd;
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+    LZ4F_cctx *lz4;
+    LZ4F_preferences_t lz4Preferences;
+    bool lz4Started;
+#endif
+
+    bool deflateZlib(const char *data, int length, QByteArray &out, int flush);
+#ifdef TILED_ZSTD_SUPPORT
+    bool compressZstd(const char *data, int length, QByteArray &out);
+    bool finishZstd(QByteArray &out);
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    bool beginLz4(QByteArray &out);
+    bool compressLz4(const char *data, int length, QByteArray &out);
+    bool finishLz4(QByteArray &out);
+#endif
+};
+
+} // namespace Tiled
+
+bool CompressorPrivate::deflateZlib(const char *data, int length,
+                                    QByteArray &out, int flush)
+{
+    const int chunkSize = 16 * 1024;
+
+    strm.next_in = (Bytef *) data;
+    strm.avail_in = length;
+
+    // Keep going until deflate leaves some output space unused, which
+    // means all input was consumed (or the stream was finished)
+    int unused;
+    do {
+        strm.next_out = (Bytef *) growOutput(out, chunkSize);
+        strm.avail_out = chunkSize;
+
+        const int ret = deflate(&strm, flush);
+
+        unused = strm.avail_out;
+        out.chop(unused);
+
+        if (ret == Z_STREAM_ERROR) {
+            logZlibError(ret);
+            error = true;
+            return false;
+        }
+    } while (unused == 0);
+
+    return true;
+}
+
+#ifdef TILED_ZSTD_SUPPORT
+bool CompressorPrivate::compressZstd(const char *data, int length,
+                                     QByteArray &out)
+{
+    const int chunkSize = int(ZSTD_CStreamOutSize());
+    ZSTD_inBuffer input = { data, size_t(length), 0 };
+
+    while (input.pos < input.size) {
+        ZSTD_outBuffer output = { growOutput(out, chunkSize), size_t(chunkSize), 0 };
+        const size_t ret = ZSTD_compressStream(zstd, &output, &input);
+        out.chop(chunkSize - int(output.pos));
+
+        if (ZSTD_isError(ret)) {
+            logZstdError(ret);
+            error = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CompressorPrivate::finishZstd(QByteArray &out)
+{
+    const int chunkSize = int(ZSTD_CStreamOutSize());
+    size_t remaining;
+
+    do {
+        ZSTD_outBuffer output = { growOutput(out, chunkSize), size_t(chunkSize), 0 };
+        remaining = ZSTD_endStream(zstd, &output);
+        out.chop(chunkSize - int(output.pos));
+
+        if (ZSTD_isError(remaining)) {
+            logZstdError(remaining);
+            error = true;
+            return false;
+        }
+    } while (remaining != 0);
+
+    return true;
+}
+
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+bool CompressorPrivate::beginLz4(QByteArray &out)
+{
+    const int headerSizeMax = 19;
+
+    const size_t ret = LZ4F_compressBegin(lz4, growOutput(out, headerSizeMax),
+                                          headerSizeMax, &lz4Preferences);
+    if (LZ4F_isError(ret)) {
+        out.chop(headerSizeMax);
+        logLz4Error(ret);
+        error = true;
+        return false;
+    }
+
+    out.chop(headerSizeMax - int(ret));
+    lz4Started = true;
+    return true;
+}
+
+bool CompressorPrivate::compressLz4(const char *data, int length,
+                                    QByteArray &out)
+{
+    if (!lz4Started && !beginLz4(out))
+        return false;
+
+    const int bound = int(LZ4F_compressBound(length, &lz4Preferences));
+    const size_t ret = LZ4F_compressUpdate(lz4, growOutput(out, bound), bound,
+                                           data, length, 0);
+    if (LZ4F_isError(ret)) {
+        out.chop(bound);
+        logLz4Error(ret);
+        error = true;
+        return false;
+    }
+
+    out.chop(bound - int(ret));
+    return true;
+}
+
+bool CompressorPrivate::finishLz4(QByteArray &out)
+{
+    if (!lz4Started && !beginLz4(out))
+        return false;
+
+    const int bound = int(LZ4F_compressBound(0, &lz4Preferences));
+    const size_t ret = LZ4F_compressEnd(lz4, growOutput(out, bound), bound, 0);
+    if (LZ4F_isError(ret)) {
+        out.chop(bound);
+        logLz4Error(ret);
+        error = true;
+        return false;
+    }
+
+    out.chop(bound - int(ret));
+    return true;
+}
+#endif
+
+Compressor::Compressor(CompressionMethod method, int level)
+    : d(new CompressorPrivate)
+{
+    d->method = method;
+
+    switch (method) {
+    case Gzip:
+    case Zlib: {
+        d->strm.zalloc = Z_NULL;
+        d->strm.zfree = Z_NULL;
+        d->strm.opaque = Z_NULL;
+
+        const int windowBits = (method == Gzip) ? 15 + 16 : 15;
+        const int ret = deflateInit2(&d->strm, zlibLevel(level), Z_DEFLATED,
+                                     windowBits, 8, Z_DEFAULT_STRATEGY);
+        d->initialized = ret == Z_OK;
+        if (!d->initialized)
+            logZlibError(ret);
+        break;
+    }
+    case Zstd:
+#ifdef TILED_ZSTD_SUPPORT
+        d->zstd = ZSTD_createCStream();
+        d->initialized = d->zstd != 0;
+        if (d->initialized)
+            ZSTD_initCStream(d->zstd, zstdLevel(level));
+#else
+        d->initialized = false;
+        logUnsupported(method);
+#endif
+        break;
+    case Lz4: {
+#ifdef TILED_LZ4_SUPPORT
+        initLz4Preferences(d->lz4Preferences, level);
+        d->lz4Started = false;
+        const size_t ret = LZ4F_createCompressionContext(&d->lz4, LZ4F_VERSION);
+        d->initialized = !LZ4F_isError(ret);
+        if (!d->initialized)
+            logLz4Error(ret);
+#else
+        d->initialized = false;
+        logUnsupported(method);
+#endif
+        break;
+    }
+    }
+
+    d->error = !d->initialized;
+}
+
+Compressor::~Compressor()
+{
+    if (d->initialized) {
+        switch (d->method) {
+        case Gzip:
+        case Zlib:
+            deflateEnd(&d->strm);
+            break;
+        case Zstd:
+#ifdef TILED_ZSTD_SUPPORT
+            ZSTD_freeCStream(d->zstd);
+#endif
+            break;
+        case Lz4:
+#ifdef TILED_LZ4_SUPPORT
+            LZ4F_freeCompressionContext(d->lz4);
+#endif
+            break;
+        }
+    }
+
+    delete d;
+}
+
+bool Compressor::hasError() const
+{
+    return d->error;
+}
+
+bool Compressor::compress(const char *data, int length, QByteArray &out)
+{
+    if (d->error)
+        return false;
+
+    switch (d->method) {
+    case Gzip:
+    case Zlib:
+        return d->deflateZlib(data, length, out, Z_NO_FLUSH);
+#ifdef TILED_ZSTD_SUPPORT
+    case Zstd:
+        return d->compressZstd(data, length, out);
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    case Lz4:
+        return d->compressLz4(data, length, out);
+#endif
+    default:
+        break;
+    }
+
+    return false;
+}
+
+bool Compressor::finish(QByteArray &out)
+{
+    if (d->error)
+        return false;
+
+    switch (d->method) {
+    case Gzip:
+    case Zlib:
+        return d->deflateZlib(0, 0, out, Z_FINISH);
+#ifdef TILED_ZSTD_SUPPORT
+    case Zstd:
+        return d->finishZstd(out);
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    case Lz4:
+        return d->finishLz4(out);
+#endif
+    default:
+        break;
+    }
+
+    return false;
+}
+
+
+namespace Tiled {
+
+class DecompressorPrivate
+{
+public:
+    CompressionMethod method;
+    bool initialized;
+    bool error;
+    bool end;
+
+    // Zlib and gzip
+    z_stream strm;
+
+#ifdef TILED_ZSTD_SUPPORT
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstdInput;
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+    LZ4F_dctx *lz4;
+    const char *lz4Input;
+    size_t lz4InputLength;
+#endif
+
+    int decompressZlib(char *out, int size);
+#ifdef TILED_ZSTD_SUPPORT
+    int decompressZstd(char *out, int size);
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    int decompressLz4(char *out, int size);
+#endif
+};
+
+} // namespace Tiled
+
+int DecompressorPrivate::decompressZlib(char *out, int size)
+{
+    strm.next_out = (Bytef *) out;
+    strm.avail_out = size;
+
+    int ret = inflate(&strm, Z_SYNC_FLUSH);
+
+    switch (ret) {
+        case Z_BUF_ERROR:
+            // No progress was possible, which is not fatal
+            break;
+        case Z_STREAM_END:
+            end = true;
+            break;
+        case Z_NEED_DICT:
+        case Z_STREAM_ERROR:
+            ret = Z_DATA_ERROR;
+        case Z_DATA_ERROR:
+        case Z_MEM_ERROR:
+            logZlibError(ret);
+            error = true;
+            return -1;
+    }
+
+    return size - strm.avail_out;
+}
+
+#ifdef TILED_ZSTD_SUPPORT
+int DecompressorPrivate::decompressZstd(char *out, int size)
+{
+    ZSTD_outBuffer output = { out, size_t(size), 0 };
+
+    const size_t ret = ZSTD_decompressStream(zstd, &output, &zstdInput);
+    if (ZSTD_isError(ret)) {
+        logZstdError(ret);
+        error = true;
+        return -1;
+    }
+
+    // A return value of 0 means the frame was completely decoded
+    end = ret == 0;
+    return int(output.pos);
+}
+
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+int DecompressorPrivate::decompressLz4(char *out, int size)
+{
+    size_t outLength = size;
+    size_t inLength = lz4InputLength;
+
+    const size_t ret = LZ4F_decompress(lz4, out, &outLength,
+                                       lz4Input, &inLength, 0);
+    if (LZ4F_isError(ret)) {
+        logLz4Error(ret);
+        error = true;
+        return -1;
+    }
+
+    lz4Input += inLength;
+    lz4InputLength -= inLength;
+
+    // A return value of 0 means the frame was completely decoded
+    end = ret == 0;
+    return int(outLength);
+}
+#endif
+
+Decompressor::Decompressor(CompressionMethod method)
+    : d(new DecompressorPrivate)
+{
+    d->method = method;
+    d->error = false;
+    d->end = false;
+
+    switch (method) {
+    case Gzip:
+    case Zlib: {
+        d->strm.zalloc = Z_NULL;
+        d->strm.zfree = Z_NULL;
+        d->strm.opaque = Z_NULL;
+        d->strm.next_in = Z_NULL;
+        d->strm.avail_in = 0;
+
+        // Automatically detects zlib or gzip headers
+        const int ret = inflateInit2(&d->strm, 15 + 32);
+        d->initialized = ret == Z_OK;
+        if (!d->initialized)
+            logZlibError(ret);
+        break;
+    }
+    case Zstd:
+#ifdef TILED_ZSTD_SUPPORT
+        d->zstd = ZSTD_createDStream();
+        d->zstdInput.src = 0;
+        d->zstdInput.size = 0;
+        d->zstdInput.pos = 0;
+        d->initialized = d->zstd != 0;
+        if (d->initialized)
+            ZSTD_initDStream(d->zstd);
+#else
+        d->initialized = false;
+        logUnsupported(method);
+#endif
+        break;
+    case Lz4: {
+#ifdef TILED_LZ4_SUPPORT
+        d->lz4Input = 0;
+        d->lz4InputLength = 0;
+        const size_t ret = LZ4F_createDecompressionContext(&d->lz4, LZ4F_VERSION);
+        d->initialized = !LZ4F_isError(ret);
+        if (!d->initialized)
+            logLz4Error(ret);
+#else
+        d->initialized = false;
+        logUnsupported(method);
+#endif
+        break;
+    }
+    }
+
+    d->error = !d->initialized;
+}
+
+Decompressor::~Decompressor()
+{
+    if (d->initialized) {
+        switch (d->method) {
+        case Gzip:
+        case Zlib:
+            inflateEnd(&d->strm);
+            break;
+        case Zstd:
+#ifdef TILED_ZSTD_SUPPORT
+            ZSTD_freeDStream(d->zstd);
+#endif
+            break;
+        case Lz4:
+#ifdef TILED_LZ4_SUPPORT
+            LZ4F_freeDecompressionContext(d->lz4);
+#endif
+            break;
+        }
+    }
+
+    delete d;
+}
+
+bool Decompressor::hasError() const
+{
+    return d->error;
+}
+
+bool Decompressor::atEnd() const
+{
+    return d->end;
+}
+
+void Decompressor::setInput(const char *data, int length)
+{
+    switch (d->method) {
+    case Gzip:
+    case Zlib:
+        d->strm.next_in = (Bytef *) data;
+        d->strm.avail_in = length;
+        break;
+#ifdef TILED_ZSTD_SUPPORT
+    case Zstd:
+        d->zstdInput.src = data;
+        d->zstdInput.size = length;
+        d->zstdInput.pos = 0;
+        break;
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    case Lz4:
+        d->lz4Input = data;
+        d->lz4InputLength = length;
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+int Decompressor::remainingInput() const
+{
+    switch (d->method) {
+    case Gzip:
+    case Zlib:
+        return d->strm.avail_in;
+#ifdef TILED_ZSTD_SUPPORT
+    case Zstd:
+        return int(d->zstdInput.size - d->zstdInput.pos);
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    case Lz4:
+        return int(d->lz4InputLength);
+#endif
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+int Decompressor::decompress(char *out, int size)
+{
+    if (d->error)
+        return -1;
+    if (d->end)
+        return 0;
+
+    switch (d->method) {
+    case Gzip:
+    case Zlib:
+        return d->decompressZlib(out, size);
+#ifdef TILED_ZSTD_SUPPORT
+    case Zstd:
+        return d->decompressZstd(out, size);
+#endif
+#ifdef TILED_LZ4_SUPPORT
+    case Lz4:
+        return d->decompressLz4(out, size);
+#endif
+    default:
+        break;
+    }
+
+    return -1;
+}
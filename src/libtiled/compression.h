@@ -31,18 +31,30 @@
 
 #include "tiled_global.h"
 
+#include <QtGlobal>
+
 class QByteArray;
 
 namespace Tiled {
 
 enum CompressionMethod {
     Gzip,
-    Zlib
+    Zlib,
+    Zstd,
+    Lz4
 };
 
 /**
- * Decompresses either zlib or gzip compressed memory. Returns a null
- * QByteArray if decompressing failed.
+ * Returns whether the given compression \a method is supported. Gzip and
+ * zlib are always supported, while Zstandard and LZ4 support depends on
+ * whether their libraries were found at build time.
+ */
+bool TILEDSHARED_EXPORT compressionSupported(CompressionMethod method);
+
+/**
+ * Decompresses memory compressed with the given \a method. Zlib and gzip
+ * compressed data are both accepted when either of them is passed. Returns
+ * a null QByteArray if decompressing failed.
  *
  * Needed because qUncompress does not support gzip compressed data. Also,
  * this method does not need the expected size to be prepended to the data,
@@ -50,22 +62,124 @@ enum CompressionMethod {
  *
  * @param data         the compressed data
  * @param expectedSize the expected size of the uncompressed data in bytes
+ * @param method       the compression method used
  * @return the uncompressed data, or a null QByteArray if decompressing failed
  */
 QByteArray TILEDSHARED_EXPORT decompress(const QByteArray &data,
-                                         int expectedSize = 1024);
+                                         int expectedSize = 1024,
+                                         CompressionMethod method = Zlib);
 
 /**
- * Compresses the give data in either gzip or zlib format. Returns a null
- * QByteArray if compression failed.
+ * Compresses the give data in gzip, zlib, Zstandard or LZ4 frame format.
+ * Returns a null QByteArray if compression failed.
  *
  * Needed because qCompress does not support gzip compression.
  *
- * @param data the uncompressed data
+ * @param data   the uncompressed data
+ * @param method the compression method to use
+ * @param level  the compression level, or -1 for the default level of
+ *               the method. Zlib and gzip take 0 to 9, Zstandard 1 to 22
+ *               and LZ4 0 to 12. Levels out of range are clamped.
  * @return the compressed data, or a null QByteArray if compression failed
  */
 QByteArray TILEDSHARED_EXPORT compress(const QByteArray &data,
-                                       CompressionMethod method = Zlib);
+                                       CompressionMethod method = Zlib,
+                                       int level = -1);
+
+class CompressorPrivate;
+
+/**
+ * Compresses data that is passed in pieces, so that the uncompressed data
+ * does not have to be held in memory as a whole.
+ *
+ * Pass the data with compress() and call finish() after the last piece.
+ * The compressed output is appended to the given byte array.
+ */
+class TILEDSHARED_EXPORT Compressor
+{
+public:
+    /**
+     * Creates a compressor for the given \a method and \a level. See
+     * compress() for the supported levels.
+     */
+    explicit Compressor(CompressionMethod method = Zlib, int level = -1);
+    ~Compressor();
+
+    /**
+     * Returns whether an error occurred while compressing.
+     */
+    bool hasError() const;
+
+    /**
+     * Compresses the next \a length bytes at \a data, appending any output
+     * to \a out. Returns false if compressing failed.
+     */
+    bool compress(const char *data, int length, QByteArray &out);
+
+    /**
+     * Ends the compressed stream, appending the remaining output to \a out.
+     * Returns false if compressing failed.
+     */
+    bool finish(QByteArray &out);
+
+private:
+    Q_DISABLE_COPY(Compressor)
+
+    CompressorPrivate *d;
+};
+
+class DecompressorPrivate;
+
+/**
+ * Decompresses data that is passed in pieces, so that neither the
+ * compressed nor the uncompressed data has to be held in memory as a whole.
+ *
+ * After passing a piece of data with setInput(), call decompress() until
+ * the input has been consumed and the output buffer is no longer filled up.
+ */
+class TILEDSHARED_EXPORT Decompressor
+{
+public:
+    /**
+     * Creates a decompressor for the given \a method. Zlib and gzip
+     * compressed data are both accepted when either of them is passed.
+     */
+    explicit Decompressor(CompressionMethod method = Zlib);
+    ~Decompressor();
+
+    /**
+     * Returns whether an error occurred while decompressing.
+     */
+    bool hasError() const;
+
+    /**
+     * Returns whether the end of the compressed stream has been reached.
+     */
+    bool atEnd() const;
+
+    /**
+     * Sets the next piece of compressed data. The data needs to stay valid
+     * until it has been consumed.
+     */
+    void setInput(const char *data, int length);
+
+    /**
+     * Returns the number of bytes of the input not consumed yet.
+     */
+    int remainingInput() const;
+
+    /**
+     * Decompresses as much of the input as fits into the \a size bytes at
+     * \a out. Returns the number of bytes written, or -1 if decompressing
+     * failed.
+     */
+    int decompress(char *out, int size);
+
+private:
+    Q_DISABLE_COPY(Decompressor)
+
+    DecompressorPrivate *d;
+};
 
 } // namespace Tiled
 
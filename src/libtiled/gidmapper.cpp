@@ -38,11 +38,17 @@ const int FlippedHorizontallyFlag   = 0x80000000;
 const int FlippedVerticallyFlag     = 0x40000000;
 const int FlippedAntiDiagonallyFlag = 0x20000000;
 
+// Upper limit on the number of entries in the gid lookup table. Global tile
+// IDs beyond the table are looked up in the tileset map instead.
+static const int MaxLookupTableSize = 1 << 20;
+
 GidMapper::GidMapper()
+    : mLowestFirstGid(0)
 {
 }
 
 GidMapper::GidMapper(const QVector<SharedTileset> &tilesets)
+    : mLowestFirstGid(0)
 {
     unsigned firstGid = 1;
     foreach (const SharedTileset &tileset, tilesets) {
@@ -51,6 +57,31 @@ GidMapper::GidMapper(const QVector<SharedTileset> &tilesets)
     }
 }
 
+void GidMapper::insert(unsigned firstGid, Tileset *tileset)
+{
+    mFirstGidToTileset.insert(firstGid, tileset);
+
+    // When a tileset is inserted more than once, its lowest gid is used
+    QHash<const Tileset*, unsigned>::iterator it =
+            mTilesetToFirstGid.find(tileset);
+    if (it == mTilesetToFirstGid.end())
+        mTilesetToFirstGid.insert(tileset, firstGid);
+    else if (firstGid < it.value())
+        it.value() = firstGid;
+
+    mLowestFirstGid = mFirstGidToTileset.firstKey();
+    updateLookupTable(firstGid);
+}
+
+void GidMapper::clear()
+{
+    mFirstGidToTileset.clear();
+    mTilesetToFirstGid.clear();
+    mTilesetColumnCounts.clear();
+    mGidToTile.clear();
+    mLowestFirstGid = 0;
+}
+
 Cell GidMapper::gidToCell(unsigned gid, bool &ok) const
 {
     Cell result;
@@ -67,31 +98,12 @@ Cell GidMapper::gidToCell(unsigned gid, bool &ok) const
 
     if (gid == 0) {
         ok = true;
-    } else if (isEmpty()) {
-        ok = false;
+    } else if (gid < unsigned(mGidToTile.size())) {
+        // Invalid global tile ID when it lies before the first tileset
+        ok = gid >= mLowestFirstGid;
+        result.tile = mGidToTile.at(gid);
     } else {
-        // Find the tileset containing this tile
-        QMap<unsigned, Tileset*>::const_iterator i = mFirstGidToTileset.upperBound(gid);
-        if (i == mFirstGidToTileset.begin()) {
-            // Invalid global tile ID, since it lies before the first tileset
-            ok = false;
-        } else {
-            --i; // Navigate one tileset back since upper bound finds the next
-            int tileId = gid - i.key();
-            const Tileset *tileset = i.value();
-
-            const int columnCount = mTilesetColumnCounts.value(tileset);
-            if (columnCount > 0 && columnCount != tileset->columnCount()) {
-                // Correct tile index for changes in image width
-                const int row = tileId / columnCount;
-                const int column = tileId % columnCount;
-                tileId = row * tileset->columnCount() + column;
-            }
-
-            result.tile = tileset->tileAt(tileId);
-
-            ok = true;
-        }
+        result.tile = lookupTile(gid, ok);
     }
 
     return result;
@@ -105,15 +117,13 @@ unsigned GidMapper::cellToGid(const Cell &cell) const
     const Tileset *tileset = cell.tile->tileset();
 
     // Find the first GID for the tileset
-    QMap<unsigned, Tileset*>::const_iterator i = mFirstGidToTileset.begin();
-    QMap<unsigned, Tileset*>::const_iterator i_end = mFirstGidToTileset.end();
-    while (i != i_end && i.value() != tileset)
-        ++i;
+    QHash<const Tileset*, unsigned>::const_iterator i =
+            mTilesetToFirstGid.find(tileset);
 
-    if (i == i_end) // tileset not found
+    if (i == mTilesetToFirstGid.end()) // tileset not found
         return 0;
 
-    unsigned gid = i.key() + cell.tile->id();
+    unsigned gid = i.value() + cell.tile->id();
     if (cell.flippedHorizontally)
         gid |= FlippedHorizontallyFlag;
     if (cell.flippedVertically)
@@ -130,4 +140,92 @@ void GidMapper::setTilesetWidth(const Tileset *tileset, int width)
         return;
 
     mTilesetColumnCounts.insert(tileset, tileset->columnCountForWidth(width));
+
+    // Update the lookup table in case the tileset was already inserted
+    QHash<const Tileset*, unsigned>::const_iterator i =
+            mTilesetToFirstGid.find(tileset);
+    if (i != mTilesetToFirstGid.end())
+        updateLookupTable(i.value());
+}
+
+/**
+ * Looks up the tile for the given \a gid (without flags) in the tileset map.
+ * Used to fill the lookup table and for gids that fall outside of it.
+ */
+Tile *GidMapper::lookupTile(unsigned gid, bool &ok) const
+{
+    if (isEmpty()) {
+        ok = false;
+        return 0;
+    }
+
+    // Find the tileset containing this tile
+    QMap<unsigned, Tileset*>::const_iterator i = mFirstGidToTileset.upperBound(gid);
+    if (i == mFirstGidToTileset.begin()) {
+        // Invalid global tile ID, since it lies before the first tileset
+        ok = false;
+        return 0;
+    }
+
+    --i; // Navigate one tileset back since upper bound finds the next
+    int tileId = gid - i.key();
+    const Tileset *tileset = i.value();
+
+    const int columnCount = mTilesetColumnCounts.value(tileset);
+    if (columnCount > 0 && columnCount != tileset->columnCount()) {
+        // Correct tile index for changes in image width
+        const int row = tileId / columnCount;
+        const int column = tileId % columnCount;
+        tileId = row * tileset->columnCount() + column;
+    }
+
+    ok = true;
+    return tileset->tileAt(tileId);
+}
+
+/**
+ * Returns the number of gids following the first gid of \a tileset that can
+ * refer to one of its tiles, taking into account a changed image width.
+ */
+int GidMapper::lookupRangeLength(const Tileset *tileset) const
+{
+    const int columnCount = mTilesetColumnCounts.value(tileset);
+    const int currentColumnCount = tileset->columnCount();
+
+    if (columnCount > 0 && currentColumnCount > 0
+            && columnCount != currentColumnCount) {
+        const int rows = (tileset->tileCount() + currentColumnCount - 1)
+                / currentColumnCount;
+        return rows * columnCount;
+    }
+
+    return tileset->tileCount();
+}
+
+/**
+ * Updates the gid lookup table from \a fromGid onwards. When tilesets are
+ * inserted in order of their first gid, this only touches the gids of the
+ * last inserted tileset.
+ */
+void GidMapper::updateLookupTable(unsigned fromGid)
+{
+    qint64 size = 0;
+
+    QMap<unsigned, Tileset*>::const_iterator i = mFirstGidToTileset.begin();
+    QMap<unsigned, Tileset*>::const_iterator i_end = mFirstGidToTileset.end();
+    for (; i != i_end; ++i)
+        size = qMax(size, qint64(i.key()) + lookupRangeLength(i.value()));
+
+    size = qMin(size, qint64(MaxLookupTableSize));
+
+    const int oldSize = mGidToTile.size();
+    if (size > oldSize) {
+        mGidToTile.resize(int(size));
+        fromGid = qMin(fromGid, unsigned(oldSize));
+    }
+
+    for (unsigned gid = fromGid; gid < unsigned(mGidToTile.size()); ++gid) {
+        bool ok;
+        mGidToTile[gid] = lookupTile(gid, ok);
+    }
 }
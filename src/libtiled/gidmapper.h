@@ -31,12 +31,19 @@
 
 #include "tilelayer.h"
 
+#include <QHash>
 #include <QMap>
+#include <QVector>
 
 namespace Tiled {
 
 /**
  * A class that maps cells to global IDs (gids) and back.
+ *
+ * Both directions are constant time lookups. The first gid of each tileset is
+ * stored in a hash, and a flat table maps gids to tiles. The table is kept
+ * up to date as tilesets are inserted, so it is built only once while reading
+ * or writing a map.
  */
 class TILEDSHARED_EXPORT GidMapper
 {
@@ -55,13 +62,12 @@ public:
     /**
      * Insert the given \a tileset with \a firstGid as its first global ID.
      */
-    void insert(unsigned firstGid, Tileset *tileset)
-    { mFirstGidToTileset.insert(firstGid, tileset); }
+    void insert(unsigned firstGid, Tileset *tileset);
 
     /**
      * Clears the gid mapper, so that it can be reused.
      */
-    void clear() { mFirstGidToTileset.clear(); }
+    void clear();
 
     /**
      * Returns true when no tilesets are known to this gid mapper.
@@ -88,8 +94,16 @@ public:
     void setTilesetWidth(const Tileset *tileset, int width);
 
 private:
+    Tile *lookupTile(unsigned gid, bool &ok) const;
+    int lookupRangeLength(const Tileset *tileset) const;
+    void updateLookupTable(unsigned fromGid);
+
     QMap<unsigned, Tileset*> mFirstGidToTileset;
-    QMap<const Tileset*, int> mTilesetColumnCounts;
+    QHash<const Tileset*, unsigned> mTilesetToFirstGid;
+    QHash<const Tileset*, int> mTilesetColumnCounts;
+
+    QVector<Tile*> mGidToTile;
+    unsigned mLowestFirstGid;
 };
 
 } // namespace Tiled
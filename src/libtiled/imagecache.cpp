@@ -0,0 +1,129 @@
+/*
+ * imagecache.cpp
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imagecache.h"
+
+#include <QCache>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+
+using namespace Tiled;
+
+namespace {
+
+struct CachedImage
+{
+    QImage image;
+    QDateTime lastModified;
+    qint64 size;
+};
+
+/**
+ * The default maximum size of the cache, in kilobytes.
+ */
+const int defaultMaximumSize = 256 * 1024;
+
+QMutex cacheMutex;
+QCache<QString, CachedImage> cache(defaultMaximumSize);
+
+int costOf(const QImage &image)
+{
+    return qMax(1, image.byteCount() / 1024);
+}
+
+} // anonymous namespace
+
+/**
+ * Returns the image stored in \a fileName, decoding it only when it is not
+ * already cached or when the file changed since it was cached.
+ *
+ * Returns a null image when the file could not be read.
+ */
+QImage ImageCache::loadImage(const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName);
+    const QString canonicalPath = fileInfo.canonicalFilePath();
+    if (canonicalPath.isEmpty())
+        return QImage(fileName);
+
+    const QDateTime lastModified = fileInfo.lastModified();
+    const qint64 size = fileInfo.size();
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        if (const CachedImage *cached = cache.object(canonicalPath))
+            if (cached->lastModified == lastModified && cached->size == size)
+                return cached->image;
+    }
+
+    // Decode without holding the lock, so that other images can be loaded
+    // in parallel
+    const QImage image(canonicalPath);
+    if (image.isNull())
+        return image;
+
+    CachedImage *cached = new CachedImage;
+    cached->image = image;
+    cached->lastModified = lastModified;
+    cached->size = size;
+
+    QMutexLocker locker(&cacheMutex);
+    cache.insert(canonicalPath, cached, costOf(image));
+
+    return image;
+}
+
+/**
+ * Returns the maximum total size of the cached images, in kilobytes.
+ */
+int ImageCache::maximumSize()
+{
+    QMutexLocker locker(&cacheMutex);
+    return cache.maxCost();
+}
+
+/**
+ * Sets the maximum total size of the cached images to \a kilobytes. Images
+ * are dropped from the cache as needed. A size of 0 disables the cache.
+ */
+void ImageCache::setMaximumSize(int kilobytes)
+{
+    QMutexLocker locker(&cacheMutex);
+    cache.setMaxCost(kilobytes);
+}
+
+/**
+ * Drops all images from the cache.
+ */
+void ImageCache::clear()
+{
+    QMutexLocker locker(&cacheMutex);
+    cache.clear();
+}
@@ -0,0 +1,63 @@
+/*
+ * imagecache.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILED_IMAGECACHE_H
+#define TILED_IMAGECACHE_H
+
+#include "tiled_global.h"
+
+#include <QImage>
+#include <QString>
+
+namespace Tiled {
+
+/**
+ * A process-wide cache of decoded images, so that an image file shared by
+ * many maps is only decoded once.
+ *
+ * Images are looked up by their canonical file path and are reloaded when
+ * the modification time or the size of the file changed. The least recently
+ * used images are dropped when the total size of the cached images exceeds
+ * the maximum size.
+ *
+ * All functions are thread-safe.
+ */
+class TILEDSHARED_EXPORT ImageCache
+{
+public:
+    static QImage loadImage(const QString &fileName);
+
+    static int maximumSize();
+    static void setMaximumSize(int kilobytes);
+
+    static void clear();
+};
+
+} // namespace Tiled
+
+#endif // TILED_IMAGECACHE_H
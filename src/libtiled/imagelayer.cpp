@@ -29,8 +29,7 @@
 
 #include "imagelayer.h"
 #include "map.h"
-
-#include <QBitmap>
+#include "transparentcolor.h"
 
 using namespace Tiled;
 
@@ -58,12 +57,10 @@ bool ImageLayer::loadFromImage(const QImage &image, const QString &fileName)
         return false;
     }
 
-    mImage = QPixmap::fromImage(image);
-
-    if (mTransparentColor.isValid()) {
-        const QImage mask = image.createMaskFromColor(mTransparentColor.rgb());
-        mImage.setMask(QBitmap::fromImage(mask));
-    }
+    if (mTransparentColor.isValid())
+        mImage = QPixmap::fromImage(applyTransparentColor(image, mTransparentColor));
+    else
+        mImage = QPixmap::fromImage(image);
 
     return true;
 }
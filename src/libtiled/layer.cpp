@@ -30,6 +30,7 @@
 #include "layer.h"
 
 #include "imagelayer.h"
+#include "map.h"
 #include "objectgroup.h"
 #include "tilelayer.h"
 
@@ -70,6 +71,18 @@ Layer *Layer::initializeClone(Layer *clone) const
     return clone;
 }
 
+void Layer::setName(const QString &name)
+{
+    if (mName == name)
+        return;
+
+    const QString oldName = mName;
+    mName = name;
+
+    if (mMap)
+        mMap->layerRenamed(this, oldName);
+}
+
 TileLayer *Layer::asTileLayer()
 {
     return isTileLayer() ? static_cast<TileLayer*>(this) : 0;
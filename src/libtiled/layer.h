@@ -79,7 +79,7 @@ public:
     /**
      * Sets the name of this layer.
      */
-    void setName(const QString &name) { mName = name; }
+    void setName(const QString &name);
 
     /**
      * Returns the opacity of this layer.
@@ -12,6 +12,8 @@ macx {
 }
 DLLDESTDIR = ../..
 
+QT += concurrent
+
 win32 {
     QMAKE_PROJECT_NAME = libtiled
 } else {
@@ -19,14 +21,27 @@ win32 {
     LIBS += -lz
 }
 
+# Zstandard and LZ4 compression of layer data are optional
+!contains(DISABLE_ZSTD, yes):unix:system(pkg-config --atleast-version=1.4.0 libzstd) {
+    DEFINES += TILED_ZSTD_SUPPORT
+    LIBS += -lzstd
+}
+!contains(DISABLE_LZ4, yes):unix:system(pkg-config --atleast-version=1.8.0 liblz4) {
+    DEFINES += TILED_LZ4_SUPPORT
+    LIBS += -llz4
+}
+
 DEFINES += QT_NO_CAST_FROM_ASCII \
     QT_NO_CAST_TO_ASCII
 DEFINES += TILED_LIBRARY
 contains(QT_CONFIG, reduce_exports): CONFIG += hide_symbols
 
-SOURCES += compression.cpp \
+SOURCES += binarymapreader.cpp \
+    binarymapwriter.cpp \
+    compression.cpp \
     gidmapper.cpp \
     hexagonalrenderer.cpp \
+    imagecache.cpp \
     imagelayer.cpp \
     isometricrenderer.cpp \
     layer.cpp \
@@ -39,14 +54,21 @@ SOURCES += compression.cpp \
     objectgroup.cpp \
     orthogonalrenderer.cpp \
     properties.cpp \
+    regionbuilder.cpp \
     staggeredrenderer.cpp \
     tile.cpp \
     tilelayer.cpp \
     tileset.cpp \
+    tilesetcache.cpp \
+    transparentcolor.cpp \
     varianttomapconverter.cpp
-HEADERS += compression.h \
+HEADERS += binarymapformat.h \
+    binarymapreader.h \
+    binarymapwriter.h \
+    compression.h \
     gidmapper.h \
     hexagonalrenderer.h \
+    imagecache.h \
     imagelayer.h \
     isometricrenderer.h \
     layer.h \
@@ -63,6 +85,7 @@ HEADERS += compression.h \
     objectgroup.h \
     orthogonalrenderer.h \
     properties.h \
+    regionbuilder.h \
     staggeredrenderer.h \
     terrain.h \
     tile.h \
@@ -70,6 +93,8 @@ HEADERS += compression.h \
     tiled_global.h \
     tilelayer.h \
     tileset.h \
+    tilesetcache.h \
+    transparentcolor.h \
     varianttomapconverter.h
 
 contains(INSTALL_HEADERS, yes) {
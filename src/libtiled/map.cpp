@@ -51,6 +51,7 @@ Map::Map(Orientation orientation,
     mStaggerAxis(StaggerY),
     mStaggerIndex(StaggerOdd),
     mLayerDataFormat(Base64Zlib),
+    mCompressionLevel(-1),
     mNextObjectId(1)
 {
 }
@@ -70,12 +71,15 @@ Map::Map(const Map &map):
     mDrawMargins(map.mDrawMargins),
     mTilesets(map.mTilesets),
     mLayerDataFormat(map.mLayerDataFormat),
+    mCompressionLevel(map.mCompressionLevel),
     mNextObjectId(1)
 {
     foreach (const Layer *layer, map.mLayers) {
         Layer *clone = layer->clone();
         clone->setMap(this);
         mLayers.append(clone);
+        mLayersByName.insert(clone->name(), clone);
+        mLayerIndexes.insert(clone, mLayers.size() - 1);
     }
 }
 
@@ -115,9 +119,38 @@ void Map::recomputeDrawMargins()
 {
     mDrawMargins = QMargins();
 
+    // Layers that are not decoded yet adjust the margins once they are
     foreach (Layer *layer, mLayers)
         if (TileLayer *tileLayer = layer->asTileLayer())
-            tileLayer->recomputeDrawMargins();
+            if (tileLayer->isDecoded())
+                tileLayer->recomputeDrawMargins();
+}
+
+QString Map::decodeLayerData()
+{
+    QString error;
+
+    foreach (Layer *layer, mLayers) {
+        if (TileLayer *tileLayer = layer->asTileLayer()) {
+            const QString layerError = tileLayer->decode();
+            if (error.isEmpty())
+                error = layerError;
+        }
+    }
+
+    return error;
+}
+
+int Map::discardDecodedLayerData()
+{
+    int count = 0;
+
+    foreach (Layer *layer, mLayers)
+        if (TileLayer *tileLayer = layer->asTileLayer())
+            if (tileLayer->discardDecodedData())
+                ++count;
+
+    return count;
 }
 
 int Map::layerCount(Layer::TypeFlag type) const
@@ -160,30 +193,47 @@ void Map::addLayer(Layer *layer)
 {
     adoptLayer(layer);
     mLayers.append(layer);
+    mLayerIndexes.insert(layer, mLayers.size() - 1);
 }
 
 int Map::indexOfLayer(const QString &layerName, unsigned layertypes) const
 {
-    for (int index = 0; index < mLayers.size(); index++)
-        if (layerAt(index)->name() == layerName
-                && (layertypes & layerAt(index)->layerType()))
-            return index;
+    int result = -1;
+
+    // Multiple layers may share the same name, in which case the lowest
+    // index is returned
+    QMultiHash<QString, Layer*>::const_iterator it =
+            mLayersByName.constFind(layerName);
+
+    for (; it != mLayersByName.constEnd() && it.key() == layerName; ++it) {
+        Layer *layer = it.value();
+        if (!(layertypes & layer->layerType()))
+            continue;
+
+        const int index = mLayerIndexes.value(layer);
+        if (result == -1 || index < result)
+            result = index;
+    }
 
-    return -1;
+    return result;
 }
 
 void Map::insertLayer(int index, Layer *layer)
 {
     adoptLayer(layer);
     mLayers.insert(index, layer);
+    updateLayerIndexes(index);
 }
 
 void Map::adoptLayer(Layer *layer)
 {
     layer->setMap(this);
+    mLayersByName.insert(layer->name(), layer);
 
+    // Lazily loaded layers adjust the margins once they are decoded
     if (TileLayer *tileLayer = layer->asTileLayer())
-        adjustDrawMargins(tileLayer->drawMargins());
+        if (tileLayer->isDecoded())
+            adjustDrawMargins(tileLayer->drawMargins());
 
     if (ObjectGroup *group = layer->asObjectGroup()) {
         foreach (MapObject *o, group->objects()) {
@@ -196,10 +246,29 @@ void Map::adoptLayer(Layer *layer)
 Layer *Map::takeLayerAt(int index)
 {
     Layer *layer = mLayers.takeAt(index);
+    mLayersByName.remove(layer->name(), layer);
+    mLayerIndexes.remove(layer);
+    updateLayerIndexes(index);
     layer->setMap(0);
     return layer;
 }
 
+/**
+ * Updates the indexes of the layers starting at \a from, after a layer was
+ * inserted or taken at that index.
+ */
+void Map::updateLayerIndexes(int from)
+{
+    for (int i = from; i < mLayers.size(); ++i)
+        mLayerIndexes[mLayers.at(i)] = i;
+}
+
+void Map::layerRenamed(Layer *layer, const QString &oldName)
+{
+    mLayersByName.remove(oldName, layer);
+    mLayersByName.insert(layer->name(), layer);
+}
+
 void Map::addTileset(const SharedTileset &tileset)
 {
     mTilesets.append(tileset);
@@ -248,6 +317,26 @@ bool Map::isTilesetUsed(const Tileset *tileset) const
     return false;
 }
 
+int Map::tilesetUseCount(const Tileset *tileset) const
+{
+    int count = 0;
+
+    foreach (const Layer *layer, mLayers) {
+        if (layer->isTileLayer()) {
+            count += static_cast<const TileLayer*>(layer)->tilesetUseCount(tileset);
+        } else if (layer->isObjectGroup()) {
+            const ObjectGroup *group = static_cast<const ObjectGroup*>(layer);
+            foreach (const MapObject *object, group->objects()) {
+                const Tile *tile = object->cell().tile;
+                if (tile && tile->tileset() == tileset)
+                    ++count;
+            }
+        }
+    }
+
+    return count;
+}
+
 
 QString Tiled::staggerAxisToString(Map::StaggerAxis staggerAxis)
 {
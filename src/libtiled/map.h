@@ -36,6 +36,7 @@
 #include "tileset.h"
 
 #include <QColor>
+#include <QHash>
 #include <QList>
 #include <QMargins>
 #include <QSize>
@@ -77,7 +78,9 @@ public:
         Base64     = 1,
         Base64Gzip = 2,
         Base64Zlib = 3,
-        CSV        = 4
+        CSV        = 4,
+        Base64Zstd = 5,
+        Base64Lz4  = 6
     };
 
     /**
@@ -223,6 +226,23 @@ public:
 
     void recomputeDrawMargins();
 
+    /**
+     * Decodes the cells of the tile layers that were loaded lazily and have
+     * not been accessed yet. Returns the first error that occurred.
+     *
+     * \sa TileLayer::decode()
+     */
+    QString decodeLayerData();
+
+    /**
+     * Releases the cells of the tile layers that can be decoded again from
+     * their encoded data, reclaiming their memory. Returns the number of
+     * layers for which this was possible.
+     *
+     * \sa TileLayer::discardDecodedData()
+     */
+    int discardDecodedLayerData();
+
     /**
      * Returns the number of layers of this map.
      */
@@ -271,6 +291,9 @@ public:
      *
      * The second optional parameter specifies the layer types which are
      * searched.
+     *
+     * The layers are looked up by name in a hash, along with their index,
+     * so this takes constant time unless many layers share the same name.
      */
     int indexOfLayer(const QString &layerName,
                      unsigned layerTypes = Layer::AnyLayerType) const;
@@ -286,6 +309,12 @@ public:
      */
     Layer *takeLayerAt(int index);
 
+    /**
+     * Updates the layer name index after \a layer was renamed from
+     * \a oldName. Should only be called from the Layer class.
+     */
+    void layerRenamed(Layer *layer, const QString &oldName);
+
     /**
      * Adds a tileset to this map. The map does not take ownership over its
      * tilesets, this is merely for keeping track of which tilesets are used by
@@ -360,6 +389,13 @@ public:
      */
     bool isTilesetUsed(const Tileset *tileset) const;
 
+    /**
+     * Returns the number of tiles on this map that are from the given
+     * \a tileset. This includes both the cells of tile layers and tile
+     * objects.
+     */
+    int tilesetUseCount(const Tileset *tileset) const;
+
     /**
      * Creates a new map that contains the given \a layer. The map size will be
      * determined by the size of the layer.
@@ -375,6 +411,14 @@ public:
     void setLayerDataFormat(LayerDataFormat format)
     { mLayerDataFormat = format; }
 
+    /**
+     * Returns the level at which the tile layer data is compressed. The
+     * meaning depends on the compression method, and -1 means the default
+     * level of the method is used.
+     */
+    int compressionLevel() const { return mCompressionLevel; }
+    void setCompressionLevel(int level) { mCompressionLevel = level; }
+
     /**
      * Sets the next id to be used for objects on this map.
      */
@@ -396,6 +440,7 @@ public:
 
 private:
     void adoptLayer(Layer *layer);
+    void updateLayerIndexes(int from);
 
     Orientation mOrientation;
     RenderOrder mRenderOrder;
@@ -409,8 +454,11 @@ private:
     QColor mBackgroundColor;
     QMargins mDrawMargins;
     QList<Layer*> mLayers;
+    QMultiHash<QString, Layer*> mLayersByName;
+    QHash<const Layer*, int> mLayerIndexes;
     QVector<SharedTileset> mTilesets;
     LayerDataFormat mLayerDataFormat;
+    int mCompressionLevel;
     int mNextObjectId;
 };
 
@@ -32,20 +32,27 @@
 
 #include "compression.h"
 #include "gidmapper.h"
+#include "imagecache.h"
 #include "imagelayer.h"
 #include "objectgroup.h"
 #include "map.h"
 #include "mapobject.h"
+#include "maprenderer.h"
 #include "tile.h"
 #include "tilelayer.h"
+#include "tilesetcache.h"
 #include "terrain.h"
 
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
+#include <QFuture>
+#include <QScopedPointer>
+#include <QThreadPool>
 #include <QVector>
 #include <QXmlStreamReader>
+#include <QtConcurrentRun>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -53,6 +60,8 @@ using namespace Tiled::Internal;
 namespace Tiled {
 namespace Internal {
 
+class TmxLayerData;
+
 class MapReaderPrivate
 {
     Q_DECLARE_TR_FUNCTIONS(MapReader)
@@ -63,7 +72,9 @@ public:
     MapReaderPrivate(MapReader *mapReader):
         p(mapReader),
         mMap(0),
-        mReadingExternalTileset(false)
+        mReadingExternalTileset(false),
+        mLazyLayerData(false),
+        mPendingLayerDataSize(0)
     {}
 
     Map *readMap(QIODevice *device, const QString &path);
@@ -73,6 +84,12 @@ public:
 
     QString errorString() const;
 
+    static QString decodeLayerDataNow(const GidMapper &gidMapper,
+                                      TileLayer *tileLayer, const QRect &area,
+                                      const QPoint &origin,
+                                      const QStringRef &text,
+                                      Map::LayerDataFormat format);
+
 private:
     void readUnknownElement();
 
@@ -85,11 +102,29 @@ private:
     QImage readImage();
 
     TileLayer *readLayer();
-    void readLayerData(TileLayer *tileLayer);
-    void decodeBinaryLayerData(TileLayer *tileLayer,
-                               const QStringRef &text,
-                               const QStringRef &compression);
-    void decodeCSVLayerData(TileLayer *tileLayer, const QString &text);
+    void readLayerData(TileLayer *tileLayer, const QRect &area);
+    void readLayerDataArea(TileLayer *tileLayer, const QRect &area,
+                           const QPoint &origin,
+                           Map::LayerDataFormat format,
+                           const QString &encodingError,
+                           TmxLayerData *encodedData);
+    void decodeLayerData(TileLayer *tileLayer,
+                         const QRect &area,
+                         const QPoint &origin,
+                         const QStringRef &text,
+                         Map::LayerDataFormat format);
+    static QString decodeBinaryLayerData(const GidMapper &gidMapper,
+                                         TileLayer *tileLayer,
+                                         const QRect &area,
+                                         const QStringRef &text,
+                                         Map::LayerDataFormat format);
+    static QString decodeCSVLayerData(const GidMapper &gidMapper,
+                                      TileLayer *tileLayer,
+                                      const QRect &area,
+                                      const QPoint &origin,
+                                      const QStringRef &text);
+    void waitForLayerData();
+    void waitForOldestLayerData();
 
     /**
      * Returns the cell for the given global tile ID. Errors are raised with
@@ -101,11 +136,20 @@ private:
      */
     Cell cellForGid(unsigned gid);
 
+    /**
+     * Returns the cell for the given global tile ID. Instead of raising
+     * errors, sets \a error when the ID is invalid, so that it can be used
+     * while decoding layer data on another thread or after reading.
+     */
+    static Cell cellForGid(const GidMapper &gidMapper, unsigned gid,
+                           QString &error);
+
     ImageLayer *readImageLayer();
     void readImageLayerImage(ImageLayer *imageLayer);
 
     ObjectGroup *readObjectGroup();
     MapObject *readObject();
+    bool isInRegion(const MapObject *object) const;
     QPolygonF readPolygon();
     QVector<Frame> readAnimationFrames();
 
@@ -118,11 +162,80 @@ private:
     QString mPath;
     Map *mMap;
     GidMapper mGidMapper;
+    QSharedPointer<const GidMapper> mSharedGidMapper;
     bool mReadingExternalTileset;
+    bool mLazyLayerData;
+    QRect mRegion;
+    QScopedPointer<MapRenderer> mRegionRenderer;
+
+    struct LayerDataDecode {
+        QFuture<QString> future;
+        int size;       // The number of characters being decoded
+    };
+
+    QList<LayerDataDecode> mLayerDataDecodes;
+    qint64 mPendingLayerDataSize;
 
     QXmlStreamReader xml;
 };
 
+/**
+ * The encoded layer data of a tile layer in a TMX file, decoded once the
+ * cells of the layer are needed. When the layer data is stored in chunks,
+ * there is a piece of text for each chunk.
+ *
+ * Keeps a reference to the tilesets, since the decoded cells refer to their
+ * tiles.
+ */
+class TmxLayerData : public EncodedLayerData
+{
+public:
+    TmxLayerData(const QSharedPointer<const GidMapper> &gidMapper,
+                 const QVector<SharedTileset> &tilesets,
+                 Map::LayerDataFormat format)
+        : mGidMapper(gidMapper)
+        , mTilesets(tilesets)
+        , mFormat(format)
+    {}
+
+    bool isEmpty() const { return mPieces.isEmpty(); }
+
+    void addText(const QRect &area, const QPoint &origin, const QString &text)
+    {
+        const Piece piece = { area, origin, text };
+        mPieces.append(piece);
+    }
+
+    QString decode(TileLayer *tileLayer) const override
+    {
+        foreach (const Piece &piece, mPieces) {
+            const QString error =
+                    MapReaderPrivate::decodeLayerDataNow(*mGidMapper,
+                                                         tileLayer,
+                                                         piece.area,
+                                                         piece.origin,
+                                                         QStringRef(&piece.text),
+                                                         mFormat);
+            if (!error.isEmpty())
+                return error;
+        }
+
+        return QString();
+    }
+
+private:
+    struct Piece {
+        QRect area;
+        QPoint origin;
+        QString text;
+    };
+
+    QSharedPointer<const GidMapper> mGidMapper;
+    QVector<SharedTileset> mTilesets;
+    Map::LayerDataFormat mFormat;
+    QVector<Piece> mPieces;
+};
+
 } // namespace Internal
 } // namespace Tiled
 
@@ -141,6 +254,7 @@ Map *MapReaderPrivate::readMap(QIODevice *device, const QString &path)
     }
 
     mGidMapper.clear();
+    mSharedGidMapper.clear();
     return map;
 }
 
@@ -239,11 +353,17 @@ Map *MapReaderPrivate::readMap()
     const int nextObjectId =
             atts.value(QLatin1String("nextobjectid")).toString().toInt();
 
+    bool compressionLevelOk;
+    const int compressionLevel =
+            atts.value(QLatin1String("compressionlevel")).toString().toInt(&compressionLevelOk);
+
     mMap = new Map(orientation, mapWidth, mapHeight, tileWidth, tileHeight);
     mMap->setHexSideLength(hexSideLength);
     mMap->setStaggerAxis(staggerAxis);
     mMap->setStaggerIndex(staggerIndex);
     mMap->setRenderOrder(renderOrder);
+    if (compressionLevelOk)
+        mMap->setCompressionLevel(compressionLevel);
     if (nextObjectId)
         mMap->setNextObjectId(nextObjectId);
 
@@ -251,25 +371,43 @@ Map *MapReaderPrivate::readMap()
     if (!bgColorString.isEmpty())
         mMap->setBackgroundColor(QColor(bgColorString.toString()));
 
+    // Used to find the objects within the region being read
+    if (!mRegion.isNull())
+        mRegionRenderer.reset(MapRenderer::create(mMap));
+
+    // The layers are only added to the map once their data has been
+    // decoded, since the decoding may still be going on in other threads
+    QList<Layer*> layers;
+
     while (xml.readNextStartElement()) {
-        if (xml.name() == QLatin1String("properties"))
+        if (xml.name() == QLatin1String("properties")) {
             mMap->mergeProperties(readProperties());
-        else if (xml.name() == QLatin1String("tileset"))
+        } else if (xml.name() == QLatin1String("tileset")) {
+            // The decoding threads use the GID mapper
+            waitForLayerData();
             mMap->addTileset(readTileset());
-        else if (xml.name() == QLatin1String("layer"))
-            mMap->addLayer(readLayer());
-        else if (xml.name() == QLatin1String("objectgroup"))
-            mMap->addLayer(readObjectGroup());
-        else if (xml.name() == QLatin1String("imagelayer"))
-            mMap->addLayer(readImageLayer());
-        else
+        } else if (xml.name() == QLatin1String("layer")) {
+            layers.append(readLayer());
+        } else if (xml.name() == QLatin1String("objectgroup")) {
+            layers.append(readObjectGroup());
+        } else if (xml.name() == QLatin1String("imagelayer")) {
+            layers.append(readImageLayer());
+        } else {
             readUnknownElement();
+        }
     }
 
+    waitForLayerData();
+    mRegionRenderer.reset();
+
     // Clean up in case of error
     if (xml.hasError()) {
+        qDeleteAll(layers);
         delete mMap;
         mMap = 0;
+    } else {
+        for (Layer *layer : layers)
+            mMap->addLayer(layer);
     }
 
     return mMap;
@@ -346,8 +484,10 @@ SharedTileset MapReaderPrivate::readTileset()
         xml.skipCurrentElement();
     }
 
-    if (tileset && !mReadingExternalTileset)
+    if (tileset && !mReadingExternalTileset) {
         mGidMapper.insert(firstGid, tileset.data());
+        mSharedGidMapper.clear();
+    }
 
     return tileset;
 }
@@ -458,6 +598,7 @@ void MapReaderPrivate::readTilesetImage(SharedTileset &tileset)
     // Set the width that the tileset had when the map was saved
     const int width = atts.value(QLatin1String("width")).toString().toInt();
     mGidMapper.setTilesetWidth(tileset.data(), width);
+    mSharedGidMapper.clear();
 
     if (!tileset->loadFromImage(readImage(), source))
         xml.raiseError(tr("Error loading tileset image:\n'%1'").arg(source));
@@ -550,14 +691,25 @@ TileLayer *MapReaderPrivate::readLayer()
     const int width = atts.value(QLatin1String("width")).toString().toInt();
     const int height = atts.value(QLatin1String("height")).toString().toInt();
 
-    TileLayer *tileLayer = new TileLayer(name, x, y, width, height);
+    // When only a region of the map is read, the layer only covers the part
+    // of the layer data within that region
+    const QRect dataBounds(x, y, width, height);
+    QRect bounds = dataBounds;
+    if (!mRegion.isNull()) {
+        bounds &= mRegion;
+        if (bounds.isEmpty())
+            bounds = QRect(mRegion.topLeft(), QSize(0, 0));
+    }
+
+    TileLayer *tileLayer = new TileLayer(name, bounds.x(), bounds.y(),
+                                         bounds.width(), bounds.height());
     readLayerAttributes(tileLayer, atts);
 
     while (xml.readNextStartElement()) {
         if (xml.name() == QLatin1String("properties"))
             tileLayer->mergeProperties(readProperties());
         else if (xml.name() == QLatin1String("data"))
-            readLayerData(tileLayer);
+            readLayerData(tileLayer, dataBounds.translated(-bounds.topLeft()));
         else
             readUnknownElement();
     }
@@ -565,7 +717,12 @@ TileLayer *MapReaderPrivate::readLayer()
     return tileLayer;
 }
 
-void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
+/**
+ * Reads the layer data of \a tileLayer, which covers the given \a area of
+ * the layer. The area is larger than the layer when only a region of the map
+ * is read.
+ */
+void MapReaderPrivate::readLayerData(TileLayer *tileLayer, const QRect &area)
 {
     Q_ASSERT(xml.isStartElement() && xml.name() == QLatin1String("data"));
 
@@ -573,143 +730,634 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
     QStringRef encoding = atts.value(QLatin1String("encoding"));
     QStringRef compression = atts.value(QLatin1String("compression"));
 
+    Map::LayerDataFormat format = Map::XML;
+    QString encodingError;
+
     if (encoding.isEmpty()) {
         mMap->setLayerDataFormat(Map::XML);
+        encodingError = tr("Unknown encoding: %1").arg(QString());
     } else if (encoding == QLatin1String("csv")) {
-        mMap->setLayerDataFormat(Map::CSV);
+        format = Map::CSV;
+        mMap->setLayerDataFormat(format);
     } else if (encoding == QLatin1String("base64")) {
         if (compression.isEmpty())
-            mMap->setLayerDataFormat(Map::Base64);
+            format = Map::Base64;
         else if (compression == QLatin1String("gzip"))
-            mMap->setLayerDataFormat(Map::Base64Gzip);
+            format = Map::Base64Gzip;
         else if (compression == QLatin1String("zlib"))
-            mMap->setLayerDataFormat(Map::Base64Zlib);
+            format = Map::Base64Zlib;
+        else if (compression == QLatin1String("zstd") && compressionSupported(Zstd))
+            format = Map::Base64Zstd;
+        else if (compression == QLatin1String("lz4") && compressionSupported(Lz4))
+            format = Map::Base64Lz4;
+        else
+            encodingError = tr("Compression method '%1' not supported")
+                    .arg(compression.toString());
+
+        if (encodingError.isEmpty())
+            mMap->setLayerDataFormat(format);
+    } else {
+        encodingError = tr("Unknown encoding: %1").arg(encoding.toString());
     }
-    // else, error handled below
 
+    // Nothing needs to be decoded when the layer is outside of the region
+    if (!area.intersects(QRect(0, 0, tileLayer->width(), tileLayer->height()))) {
+        xml.skipCurrentElement();
+        return;
+    }
+
+    // In lazy mode, the encoded text is kept for decoding it later. Since
+    // the decoded cells only depend on the tilesets read so far, the layers
+    // share a copy of the gid mapper.
+    QSharedPointer<TmxLayerData> encodedData;
+    if (mLazyLayerData && format != Map::XML && encodingError.isEmpty()) {
+        if (!mSharedGidMapper)
+            mSharedGidMapper.reset(new GidMapper(mGidMapper));
+
+        encodedData.reset(new TmxLayerData(mSharedGidMapper,
+                                           mMap->tilesets(),
+                                           format));
+    }
+
+    readLayerDataArea(tileLayer, area, area.topLeft(), format, encodingError,
+                      encodedData.data());
+
+    if (encodedData && !encodedData->isEmpty() && !xml.hasError())
+        tileLayer->setEncodedData(encodedData);
+}
+
+namespace {
+
+/**
+ * Stores the rows of cells decoded for an area of a tile layer. When only a
+ * region of the map is read, the area can lie partly outside of the layer.
+ * The cells outside of the layer don't need to be looked up and are not
+ * stored.
+ */
+class LayerRowWriter
+{
+public:
+    LayerRowWriter(TileLayer *tileLayer, const QRect &area)
+        : mTileLayer(tileLayer)
+        , mX(area.x())
+        , mBegin(qBound(0, -area.x(), area.width()))
+        , mEnd(qBound(mBegin, tileLayer->width() - area.x(), area.width()))
+    {}
+
+    /**
+     * Returns whether the cell at column \a x of the area is stored for row
+     * \a y of the layer.
+     */
+    bool isNeeded(int x, int y) const
+    {
+        return x >= mBegin && x < mEnd && y >= 0 && y < mTileLayer->height();
+    }
+
+    /**
+     * Stores the first \a count \a cells of a row of the area at row \a y
+     * of the layer.
+     */
+    void storeRow(int y, const Cell *cells, int count) const
+    {
+        const int end = qMin(mEnd, count);
+        if (mBegin < end && y >= 0 && y < mTileLayer->height())
+            mTileLayer->setCells(mX + mBegin, y, end - mBegin, cells + mBegin);
+    }
+
+private:
+    TileLayer *mTileLayer;
+    int mX;
+    int mBegin;
+    int mEnd;
+};
+
+} // anonymous namespace
+
+/**
+ * Reads the contents of a <data> element, or of one of the <chunk> elements
+ * it contains, into the given \a area of the tile layer. The \a origin is
+ * where the whole layer data starts in the tile layer, so that errors report
+ * positions in the layer as stored in the file. The encoding error is
+ * raised when encoded data is found in an unknown encoding. Chunks outside
+ * of the layer are skipped.
+ *
+ * When \a encodedData is given, encoded text is added to it instead of
+ * being decoded.
+ */
+void MapReaderPrivate::readLayerDataArea(TileLayer *tileLayer,
+                                         const QRect &area,
+                                         const QPoint &origin,
+                                         Map::LayerDataFormat format,
+                                         const QString &encodingError,
+                                         TmxLayerData *encodedData)
+{
+    const bool isChunk = xml.name() == QLatin1String("chunk");
+    bool hasText = false;
+
+    const LayerRowWriter rows(tileLayer, area);
     int x = 0;
     int y = 0;
+    QVector<Cell> row(area.width());
 
     while (xml.readNext() != QXmlStreamReader::Invalid) {
         if (xml.isEndElement())
             break;
         else if (xml.isStartElement()) {
             if (xml.name() == QLatin1String("tile")) {
-                if (y >= tileLayer->height()) {
+                if (y >= area.height()) {
                     xml.raiseError(tr("Too many <tile> elements"));
                     continue;
                 }
 
                 const QXmlStreamAttributes atts = xml.attributes();
                 unsigned gid = atts.value(QLatin1String("gid")).toString().toUInt();
-                tileLayer->setCell(x, y, cellForGid(gid));
+                if (rows.isNeeded(x, area.y() + y))
+                    row[x] = cellForGid(gid);
 
                 x++;
-                if (x >= tileLayer->width()) {
+                if (x >= area.width()) {
+                    rows.storeRow(area.y() + y, row.constData(), x);
                     x = 0;
                     y++;
                 }
 
                 xml.skipCurrentElement();
+            } else if (xml.name() == QLatin1String("chunk") && !isChunk) {
+                const QXmlStreamAttributes atts = xml.attributes();
+                const QRect chunk = QRect(atts.value(QLatin1String("x")).toString().toInt(),
+                                          atts.value(QLatin1String("y")).toString().toInt(),
+                                          atts.value(QLatin1String("width")).toString().toInt(),
+                                          atts.value(QLatin1String("height")).toString().toInt())
+                        .translated(area.topLeft());
+
+                if (chunk.isEmpty() || !area.contains(chunk)) {
+                    xml.raiseError(tr("Invalid chunk in layer '%1'")
+                                   .arg(tileLayer->name()));
+                    continue;
+                }
+
+                // Chunks outside of the region being read are not needed
+                if (!chunk.intersects(QRect(0, 0, tileLayer->width(), tileLayer->height()))) {
+                    xml.skipCurrentElement();
+                    continue;
+                }
+
+                // Any layer data still being decoded by the thread pool needs
+                // to be done before a chunk is written to the same layer
+                if (hasText) {
+                    waitForLayerData();
+                    hasText = false;
+                }
+
+                readLayerDataArea(tileLayer, chunk, origin, format,
+                                  encodingError, encodedData);
             } else {
                 readUnknownElement();
             }
         } else if (xml.isCharacters() && !xml.isWhitespace()) {
-            if (encoding == QLatin1String("base64")) {
-                decodeBinaryLayerData(tileLayer,
-                                      xml.text(),
-                                      compression);
-            } else if (encoding == QLatin1String("csv")) {
-                decodeCSVLayerData(tileLayer, xml.text().toString());
+            if (!encodingError.isEmpty()) {
+                xml.raiseError(encodingError);
+                continue;
+            }
+
+            // Chunks are decoded directly, since they would otherwise be
+            // written to the same layer from several threads
+            if (encodedData) {
+                encodedData->addText(area, origin, xml.text().toString());
+            } else if (isChunk) {
+                const QString error = decodeLayerDataNow(mGidMapper, tileLayer,
+                                                         area, origin,
+                                                         xml.text(), format);
+                if (!error.isEmpty())
+                    xml.raiseError(error);
             } else {
-                xml.raiseError(tr("Unknown encoding: %1")
-                               .arg(encoding.toString()));
+                decodeLayerData(tileLayer, area, origin, xml.text(), format);
+                hasText = true;
+            }
+        }
+    }
+
+    // Store any incomplete last row of <tile> elements
+    if (x > 0)
+        rows.storeRow(area.y() + y, row.constData(), x);
+}
+
+namespace {
+
+/**
+ * Returns the value of the base64 digit \a c, or -1 if it is not one.
+ */
+inline int base64Value(ushort c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+/**
+ * Decodes base64 encoded text that is passed in pieces. Like
+ * QByteArray::fromBase64, it skips any characters that are not base64
+ * digits, like whitespace and padding.
+ */
+class Base64Decoder
+{
+public:
+    Base64Decoder()
+        : mBuffer(0)
+        , mBits(0)
+    {}
+
+    /**
+     * Decodes the characters from \a begin to \a end into \a out, which
+     * needs room for 3 bytes per 4 characters plus 1. Returns the number of
+     * bytes written.
+     */
+    int decode(const QChar *begin, const QChar *end, uchar *out)
+    {
+        uchar *o = out;
+
+        for (; begin != end; ++begin) {
+            const int value = base64Value(begin->unicode());
+            if (value < 0)
                 continue;
+
+            mBuffer = (mBuffer << 6) | value;
+            mBits += 6;
+
+            if (mBits >= 8) {
+                mBits -= 8;
+                *o++ = uchar(mBuffer >> mBits);
             }
         }
+
+        return o - out;
+    }
+
+private:
+    unsigned mBuffer;
+    int mBits;
+};
+
+CompressionMethod compressionMethod(Map::LayerDataFormat format)
+{
+    switch (format) {
+    case Map::Base64Zstd:
+        return Zstd;
+    case Map::Base64Lz4:
+        return Lz4;
+    default:
+        // Zlib and gzip compressed data are both accepted
+        return Zlib;
     }
 }
 
-void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
-                                             const QStringRef &text,
-                                             const QStringRef &compression)
+// The number of characters decoded at a time
+const int base64BlockSize = 16 * 1024;
+
+// Enough for a decoded block and an incomplete global tile ID
+const int decodedBlockSize = base64BlockSize / 4 * 3 + 4;
+
+const int decompressedBlockSize = 16 * 1024;
+
+// The number of characters of layer data that may be waiting to be decoded,
+// since each layer's text is copied for the thread pool
+const qint64 maxPendingLayerDataSize = 16 * 1024 * 1024;
+
+// The number of layers that may be waiting to be decoded, relative to the
+// number of threads in the pool
+const int maxPendingLayerDataDecodesPerThread = 2;
+
+} // anonymous namespace
+
+/**
+ * Decodes the \a text of the layer data of \a tileLayer in the given
+ * \a format, covering the given \a area of the layer, where the layer data
+ * starts at \a origin. Large layers are decoded by the global thread pool
+ * while reading the map continues, until waitForLayerData() is called. To
+ * bound the memory used by the copied text, reading waits for the oldest
+ * layers when too much is still pending.
+ */
+void MapReaderPrivate::decodeLayerData(TileLayer *tileLayer,
+                                       const QRect &area,
+                                       const QPoint &origin,
+                                       const QStringRef &text,
+                                       Map::LayerDataFormat format)
 {
-    QByteArray tileData = QByteArray::fromBase64(text.toLatin1());
-    const int size = (tileLayer->width() * tileLayer->height()) * 4;
-
-    if (compression == QLatin1String("zlib")
-        || compression == QLatin1String("gzip")) {
-        tileData = decompress(tileData, size);
-    } else if (!compression.isEmpty()) {
-        xml.raiseError(tr("Compression method '%1' not supported")
-                       .arg(compression.toString()));
+    // Small layers are not worth the overhead of another thread
+    if (text.size() < 64 * 1024) {
+        const QString error = decodeLayerDataNow(mGidMapper, tileLayer, area,
+                                                 origin, text, format);
+        if (!error.isEmpty())
+            xml.raiseError(error);
         return;
     }
 
-    if (size != tileData.length()) {
-        xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                       .arg(tileLayer->name()));
-        return;
+    const int maxPendingDecodes = maxPendingLayerDataDecodesPerThread *
+            qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+
+    while (!mLayerDataDecodes.isEmpty() &&
+           (mLayerDataDecodes.size() >= maxPendingDecodes ||
+            mPendingLayerDataSize + text.size() > maxPendingLayerDataSize)) {
+        waitForOldestLayerData();
     }
 
-    const unsigned char *data =
-            reinterpret_cast<const unsigned char*>(tileData.constData());
+    // The text is only valid until the next token is read
+    const QString data = text.toString();
+
+    LayerDataDecode decode;
+    decode.size = data.size();
+    decode.future = QtConcurrent::run([=] {
+        return decodeLayerDataNow(mGidMapper, tileLayer, area, origin,
+                                  QStringRef(&data), format);
+    });
+
+    mLayerDataDecodes.append(decode);
+    mPendingLayerDataSize += decode.size;
+}
+
+/**
+ * Decodes the layer data for the given \a area of the tile layer directly.
+ * Only the cells within the layer are stored. Returns an error message, or
+ * an empty string when successful.
+ */
+QString MapReaderPrivate::decodeLayerDataNow(const GidMapper &gidMapper,
+                                             TileLayer *tileLayer,
+                                             const QRect &area,
+                                             const QPoint &origin,
+                                             const QStringRef &text,
+                                             Map::LayerDataFormat format)
+{
+    if (format == Map::CSV)
+        return decodeCSVLayerData(gidMapper, tileLayer, area, origin, text);
+
+    return decodeBinaryLayerData(gidMapper, tileLayer, area, text, format);
+}
+
+/**
+ * Waits until all layer data handed to the thread pool has been decoded.
+ * The first error that occurred, if any, is raised.
+ */
+void MapReaderPrivate::waitForLayerData()
+{
+    while (!mLayerDataDecodes.isEmpty())
+        waitForOldestLayerData();
+}
+
+/**
+ * Waits until the layer data that was handed to the thread pool first has
+ * been decoded, raising its error if there was one.
+ */
+void MapReaderPrivate::waitForOldestLayerData()
+{
+    const LayerDataDecode decode = mLayerDataDecodes.takeFirst();
+    mPendingLayerDataSize -= decode.size;
+
+    const QString error = decode.future.result();
+    if (!error.isEmpty() && !xml.hasError())
+        xml.raiseError(error);
+}
+
+/**
+ * Decodes the base64 encoded and possibly compressed layer data a block at
+ * a time, storing the cells a row at a time. This avoids keeping the
+ * decoded and decompressed data of the whole layer in memory.
+ */
+QString MapReaderPrivate::decodeBinaryLayerData(const GidMapper &gidMapper,
+                                                TileLayer *tileLayer,
+                                                const QRect &area,
+                                                const QStringRef &text,
+                                                Map::LayerDataFormat format)
+{
+    const bool compressed = format != Map::Base64;
+    QString error;
+
+    const LayerRowWriter rows(tileLayer, area);
+    const int width = area.width();
+    QVector<Cell> row(width);
+    Cell *cells = row.data();
     int x = 0;
-    int y = 0;
+    int y = area.y();
+    int remaining = width * area.height();
+    bool tooMuchData = false;
+
+    // Stores the complete global tile IDs in the given data and moves any
+    // remaining bytes to the start, returning their number
+    auto storeGids = [&] (uchar *data, int length) -> int {
+        const int end = length & ~3;
+
+        for (int i = 0; i < end; i += 4) {
+            if (remaining == 0) {
+                tooMuchData = true;
+                return 0;
+            }
+
+            const unsigned gid = data[i] |
+                                 data[i + 1] << 8 |
+                                 data[i + 2] << 16 |
+                                 data[i + 3] << 24;
+
+            if (rows.isNeeded(x, y)) {
+                cells[x] = cellForGid(gidMapper, gid, error);
+                if (!error.isEmpty())
+                    return 0;
+            }
+            --remaining;
+
+            if (++x == width) {
+                rows.storeRow(y, cells, width);
+                x = 0;
+                ++y;
+            }
+        }
+
+        memmove(data, data + end, length - end);
+        return length - end;
+    };
+
+    Base64Decoder base64;
+    Decompressor decompressor(compressionMethod(format));
+    uchar decoded[decodedBlockSize];
+    uchar decompressed[decompressedBlockSize];
+    int pending = 0;    // bytes of an incomplete global tile ID
+    bool corrupt = false;
+
+    const QChar *input = text.unicode();
+    const QChar *inputEnd = input + text.size();
+
+    while (input != inputEnd && !corrupt && !tooMuchData && error.isEmpty()) {
+        const QChar *blockEnd = input + qMin(int(inputEnd - input),
+                                             base64BlockSize);
+
+        if (!compressed) {
+            const int length = base64.decode(input, blockEnd, decoded + pending);
+            pending = storeGids(decoded, pending + length);
+            input = blockEnd;
+            continue;
+        }
 
-    for (int i = 0; i < size - 3; i += 4) {
-        const unsigned gid = data[i] |
-                             data[i + 1] << 8 |
-                             data[i + 2] << 16 |
-                             data[i + 3] << 24;
+        const int length = base64.decode(input, blockEnd, decoded);
+        input = blockEnd;
 
-        tileLayer->setCell(x, y, cellForGid(gid));
+        if (length == 0)
+            continue;
 
-        x++;
-        if (x == tileLayer->width()) {
-            x = 0;
-            y++;
+        // There should be no data after the end of the compressed stream
+        if (decompressor.atEnd()) {
+            corrupt = true;
+            break;
         }
+
+        decompressor.setInput(reinterpret_cast<const char*>(decoded), length);
+
+        for (;;) {
+            const int space = decompressedBlockSize - pending;
+            char *out = reinterpret_cast<char*>(decompressed + pending);
+            const int written = decompressor.decompress(out, space);
+            if (written < 0) {
+                corrupt = true;
+                break;
+            }
+
+            pending = storeGids(decompressed, pending + written);
+            if (tooMuchData || !error.isEmpty())
+                break;
+
+            if (decompressor.atEnd()) {
+                corrupt = decompressor.remainingInput() > 0;
+                break;
+            }
+            if (written < space && decompressor.remainingInput() == 0)
+                break;
+        }
+    }
+
+    if (!error.isEmpty())
+        return error;
+
+    if (corrupt || tooMuchData || remaining > 0 || pending > 0 ||
+            (compressed && !decompressor.atEnd())) {
+        return tr("Corrupt layer data for layer '%1'").arg(tileLayer->name());
     }
+
+    return QString();
 }
 
-void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer, const QString &text)
+/**
+ * Parses the comma separated global tile IDs directly from the text,
+ * storing the cells a row at a time.
+ */
+QString MapReaderPrivate::decodeCSVLayerData(const GidMapper &gidMapper,
+                                             TileLayer *tileLayer,
+                                             const QRect &area,
+                                             const QPoint &origin,
+                                             const QStringRef &text)
 {
-    QString trimText = text.trimmed();
-    QStringList tiles = trimText.split(QLatin1Char(','));
+    QString error;
 
-    if (tiles.length() != tileLayer->width() * tileLayer->height()) {
-        xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                       .arg(tileLayer->name()));
-        return;
-    }
+    const LayerRowWriter rows(tileLayer, area);
+    const int width = area.width();
+    const int cellCount = width * area.height();
+    QVector<Cell> row(width);
+    Cell *cells = row.data();
+
+    const QChar *c = text.unicode();
+    const QChar *end = c + text.size();
+
+    int index = 0;
+    int invalidIndex = -1;
+    int x = 0;
+    int y = area.y();
+
+    for (;;) {
+        // Parse a global tile ID, allowing whitespace around it
+        while (c != end && c->isSpace())
+            ++c;
+
+        quint64 gid = 0;
+        const QChar *digits = c;
+        while (c != end && c->unicode() >= '0' && c->unicode() <= '9' &&
+               gid <= 0xFFFFFFFF) {
+            gid = gid * 10 + (c->unicode() - '0');
+            ++c;
+        }
+        const bool valid = c != digits && gid <= 0xFFFFFFFF;
+
+        while (c != end && c->isSpace())
+            ++c;
+
+        const bool atSeparator = c != end && *c == QLatin1Char(',');
 
-    for (int y = 0; y < tileLayer->height(); y++) {
-        for (int x = 0; x < tileLayer->width(); x++) {
-            bool conversionOk;
-            const unsigned gid = tiles.at(y * tileLayer->width() + x)
-                    .toUInt(&conversionOk);
-            if (!conversionOk) {
-                xml.raiseError(
-                        tr("Unable to parse tile at (%1,%2) on layer '%3'")
-                               .arg(x + 1).arg(y + 1).arg(tileLayer->name()));
-                return;
+        // Only the number of IDs matters after an invalid one was found
+        if (index < cellCount && invalidIndex == -1) {
+            if (valid && (atSeparator || c == end)) {
+                if (rows.isNeeded(x, y)) {
+                    cells[x] = cellForGid(gidMapper, unsigned(gid), error);
+                    if (!error.isEmpty())
+                        return error;
+                }
+                if (++x == width) {
+                    rows.storeRow(y, cells, width);
+                    x = 0;
+                    ++y;
+                }
+            } else {
+                invalidIndex = index;
             }
-            tileLayer->setCell(x, y, cellForGid(gid));
         }
+
+        ++index;
+
+        // Skip to the next separator, in case of an invalid ID
+        while (c != end && *c != QLatin1Char(','))
+            ++c;
+        if (c == end)
+            break;
+        ++c;
     }
+
+    if (index != cellCount)
+        return tr("Corrupt layer data for layer '%1'").arg(tileLayer->name());
+
+    if (invalidIndex != -1) {
+        return tr("Unable to parse tile at (%1,%2) on layer '%3'")
+                .arg(area.x() - origin.x() + invalidIndex % width + 1)
+                .arg(area.y() - origin.y() + invalidIndex / width + 1)
+                .arg(tileLayer->name());
+    }
+
+    return QString();
 }
 
 Cell MapReaderPrivate::cellForGid(unsigned gid)
+{
+    QString error;
+    const Cell result = cellForGid(mGidMapper, gid, error);
+
+    if (!error.isEmpty())
+        xml.raiseError(error);
+
+    return result;
+}
+
+Cell MapReaderPrivate::cellForGid(const GidMapper &gidMapper, unsigned gid,
+                                  QString &error)
 {
     bool ok;
-    const Cell result = mGidMapper.gidToCell(gid, ok);
+    const Cell result = gidMapper.gidToCell(gid, ok);
 
     if (!ok) {
-        if (mGidMapper.isEmpty())
-            xml.raiseError(tr("Tile used but no tilesets specified"));
+        if (gidMapper.isEmpty())
+            error = tr("Tile used but no tilesets specified");
         else
-            xml.raiseError(tr("Invalid tile: %1").arg(gid));
+            error = tr("Invalid tile: %1").arg(gid);
     }
 
     return result;
@@ -745,12 +1393,17 @@ ObjectGroup *MapReaderPrivate::readObjectGroup()
     }
 
     while (xml.readNextStartElement()) {
-        if (xml.name() == QLatin1String("object"))
-            objectGroup->addObject(readObject());
-        else if (xml.name() == QLatin1String("properties"))
+        if (xml.name() == QLatin1String("object")) {
+            MapObject *object = readObject();
+            if (isInRegion(object))
+                objectGroup->addObject(object);
+            else
+                delete object;
+        } else if (xml.name() == QLatin1String("properties")) {
             objectGroup->mergeProperties(readProperties());
-        else
+        } else {
             readUnknownElement();
+        }
     }
 
     return objectGroup;
@@ -867,6 +1520,19 @@ MapObject *MapReaderPrivate::readObject()
     return object;
 }
 
+/**
+ * Returns whether the \a object intersects the region of the map being read.
+ * Always true when the whole map is read.
+ */
+bool MapReaderPrivate::isInRegion(const MapObject *object) const
+{
+    if (!mRegionRenderer)
+        return true;
+
+    const QRectF regionBounds = mRegionRenderer->boundingRect(mRegion);
+    return mRegionRenderer->boundingRect(object).intersects(regionBounds);
+}
+
 QPolygonF MapReaderPrivate::readPolygon()
 {
     Q_ASSERT(xml.isStartElement() && (xml.name() == QLatin1String("polygon") ||
@@ -1014,6 +1680,26 @@ QString MapReader::errorString() const
     return d->errorString();
 }
 
+void MapReader::setLazyLayerDataEnabled(bool enabled)
+{
+    d->mLazyLayerData = enabled;
+}
+
+bool MapReader::isLazyLayerDataEnabled() const
+{
+    return d->mLazyLayerData;
+}
+
+void MapReader::setRegion(const QRect &region)
+{
+    d->mRegion = region;
+}
+
+QRect MapReader::region() const
+{
+    return d->mRegion;
+}
+
 QString MapReader::resolveReference(const QString &reference,
                                     const QString &mapPath)
 {
@@ -1025,17 +1711,26 @@ QString MapReader::resolveReference(const QString &reference,
 
 QImage MapReader::readExternalImage(const QString &source)
 {
-    return QImage(source);
+    return ImageCache::loadImage(source);
 }
 
 SharedTileset MapReader::readExternalTileset(const QString &source,
                                              QString *error)
 {
+    const bool useCache = TilesetCache::isEnabled();
+
+    if (useCache) {
+        if (SharedTileset tileset = TilesetCache::find(source))
+            return tileset;
+    }
+
     MapReader reader;
 
     SharedTileset tileset = reader.readTileset(source);
     if (!tileset)
         *error = reader.errorString();
+    else if (useCache)
+        TilesetCache::insert(source, tileset);
 
     return tileset;
 }
@@ -33,6 +33,7 @@
 #include "tileset.h"
 
 #include <QImage>
+#include <QRect>
 
 class QFile;
 
@@ -95,6 +96,28 @@ public:
      */
     QString errorString() const;
 
+    /**
+     * Sets whether encoded tile layer data is decoded lazily. When enabled,
+     * tile layers keep their encoded data and decode it when their cells
+     * are first needed, so that layers that are never looked at aren't
+     * decoded at all. Errors in the data are then only found once it is
+     * decoded, see Map::decodeLayerData(). Disabled by default.
+     */
+    void setLazyLayerDataEnabled(bool enabled);
+    bool isLazyLayerDataEnabled() const;
+
+    /**
+     * Sets the \a region of the map, in tiles, that is read. The map keeps
+     * its size, but each tile layer only covers the part of it within the
+     * region and is positioned there. Only the layer data within the region
+     * is decoded and chunks outside of it are skipped. Objects are only read
+     * when they intersect the region.
+     *
+     * A null rectangle, the default, reads the whole map.
+     */
+    void setRegion(const QRect &region);
+    QRect region() const;
+
 protected:
     /**
      * Called for each \a reference to an external file. Should return the path
@@ -106,12 +129,14 @@ protected:
 
     /**
      * Called when an external image is encountered while a tileset is loaded.
+     * The default implementation loads the image through the ImageCache.
      */
     virtual QImage readExternalImage(const QString &source);
 
     /**
      * Called when an external tileset is encountered while a map is loaded.
-     * The default implementation just calls readTileset() on a new MapReader.
+     * The default implementation calls readTileset() on a new MapReader,
+     * reusing the tileset from the TilesetCache when it is enabled.
      *
      * If an error occurred, the \a error parameter should be set to the error
      * message.
@@ -28,7 +28,12 @@
 
 #include "maprenderer.h"
 
+#include "hexagonalrenderer.h"
 #include "imagelayer.h"
+#include "isometricrenderer.h"
+#include "map.h"
+#include "orthogonalrenderer.h"
+#include "staggeredrenderer.h"
 #include "tile.h"
 #include "tilelayer.h"
 
@@ -38,6 +43,20 @@
 
 using namespace Tiled;
 
+MapRenderer *MapRenderer::create(const Map *map)
+{
+    switch (map->orientation()) {
+    case Map::Isometric:
+        return new IsometricRenderer(map);
+    case Map::Staggered:
+        return new StaggeredRenderer(map);
+    case Map::Hexagonal:
+        return new HexagonalRenderer(map);
+    default:
+        return new OrthogonalRenderer(map);
+    }
+}
+
 QRectF MapRenderer::boundingRect(const ImageLayer *imageLayer) const
 {
     return QRectF(imageLayer->position(),
@@ -91,9 +110,11 @@ static bool hasOpenGLEngine(const QPainter *painter)
             type == QPaintEngine::OpenGL2);
 }
 
-CellRenderer::CellRenderer(QPainter *painter)
+CellRenderer::CellRenderer(QPainter *painter, Ordering ordering)
     : mPainter(painter)
-    , mTile(0)
+    , mOrdering(ordering)
+    , mBatchCount(0)
+    , mLastBatch(0)
     , mIsOpenGL(hasOpenGLEngine(painter))
 {
 }
@@ -102,18 +123,23 @@ CellRenderer::CellRenderer(QPainter *painter)
  * Renders a \a cell with the given \a origin at \a pos, taking into account
  * the flipping and tile offset.
  *
- * For performance reasons, the actual drawing is delayed until a different
- * kind of tile has to be drawn. For this reason it is necessary to call
+ * For performance reasons, the actual drawing is delayed until a tile from a
+ * different pixmap has to be drawn. Since the tiles of a tileset image share
+ * a single pixmap, consecutive tiles from the same tileset are drawn in one
+ * batch. When reordering is allowed, the cells are instead grouped by pixmap
+ * until the next flush, needing only one batch per tileset.
+ *
+ * For this reason it is necessary to call
  * flush when finished doing drawCell calls. This function is also called by
  * the destructor so usually an explicit call is not needed.
  */
 void CellRenderer::render(const Cell &cell, const QPointF &pos, const QSizeF &cellSize, Origin origin)
 {
-    if (mTile != cell.tile)
-        flush();
+    const Tile *tile = cell.tile->currentFrameTile();
+    const QPixmap &image = tile->atlasPixmap();
+    const QRect &imageRect = tile->imageRect();
 
-    const QPixmap &image = cell.tile->currentFrameImage();
-    const QSizeF size = image.size();
+    const QSizeF size = imageRect.size();
     const QSizeF objectSize = (cellSize == QSizeF(0,0)) ? size : cellSize;
     const QSizeF scale(objectSize.width() / size.width(), objectSize.height() / size.height());
     const QPoint offset = cell.tile->offset();
@@ -122,8 +148,8 @@ void CellRenderer::render(const Cell &cell, const QPointF &pos, const QSizeF &ce
     QPainter::PixmapFragment fragment;
     fragment.x = pos.x() + (offset.x() * scale.width()) + sizeHalf.x();
     fragment.y = pos.y() + (offset.y() * scale.height()) + sizeHalf.y() - objectSize.height();
-    fragment.sourceLeft = 0;
-    fragment.sourceTop = 0;
+    fragment.sourceLeft = imageRect.x();
+    fragment.sourceTop = imageRect.y();
     fragment.width = size.width();
     fragment.height = size.height();
     fragment.scaleX = cell.flippedHorizontally ? -1 : 1;
@@ -154,15 +180,15 @@ void CellRenderer::render(const Cell &cell, const QPointF &pos, const QSizeF &ce
     fragment.scaleY = scale.height() * (flippedVertically ? -1 : 1);
 
     if (mIsOpenGL || (fragment.scaleX > 0 && fragment.scaleY > 0)) {
-        mTile = cell.tile;
-        mFragments.append(fragment);
+        batchFor(image).fragments.append(fragment);
         return;
     }
 
     // The Raster paint engine as of Qt 4.8.4 / 5.0.2 does not support
     // drawing fragments with a negative scaling factor.
 
-    flush(); // make sure we drew all tiles so far
+    if (mOrdering == KeepOrder)
+        flush(); // make sure we drew all tiles so far
 
     const QTransform oldTransform = mPainter->transform();
     QTransform transform = oldTransform;
@@ -172,7 +198,7 @@ void CellRenderer::render(const Cell &cell, const QPointF &pos, const QSizeF &ce
 
     const QRectF target(fragment.width * -0.5, fragment.height * -0.5,
                         fragment.width, fragment.height);
-    const QRectF source(0, 0, fragment.width, fragment.height);
+    const QRectF source(imageRect);
 
     mPainter->setTransform(transform);
     mPainter->drawPixmap(target, image, source);
@@ -184,13 +210,49 @@ void CellRenderer::render(const Cell &cell, const QPointF &pos, const QSizeF &ce
  */
 void CellRenderer::flush()
 {
-    if (!mTile)
-        return;
+    for (int i = 0; i < mBatchCount; ++i) {
+        Batch &batch = mBatches[i];
+
+        mPainter->drawPixmapFragments(batch.fragments.constData(),
+                                      batch.fragments.size(),
+                                      batch.pixmap);
+
+        batch.pixmap = QPixmap();
+        batch.fragments.resize(0);
+    }
+
+    mBatchCount = 0;
+    mLastBatch = 0;
+}
+
+/**
+ * Returns the batch to add fragments drawing from \a pixmap to. When the
+ * order needs to be kept, this flushes any batch for a different pixmap.
+ */
+CellRenderer::Batch &CellRenderer::batchFor(const QPixmap &pixmap)
+{
+    const qint64 key = pixmap.cacheKey();
+
+    if (mBatchCount > 0 && mBatches.at(mLastBatch).pixmap.cacheKey() == key)
+        return mBatches[mLastBatch];
+
+    if (mOrdering == KeepOrder) {
+        flush();
+    } else {
+        for (int i = 0; i < mBatchCount; ++i) {
+            if (mBatches.at(i).pixmap.cacheKey() == key) {
+                mLastBatch = i;
+                return mBatches[i];
+            }
+        }
+    }
 
-    mPainter->drawPixmapFragments(mFragments.constData(),
-                                  mFragments.size(),
-                                  mTile->currentFrameImage());
+    // Batches are reused between flushes to keep their allocated fragments
+    if (mBatchCount == mBatches.size())
+        mBatches.append(Batch());
 
-    mTile = 0;
-    mFragments.resize(0);
+    mLastBatch = mBatchCount++;
+    Batch &batch = mBatches[mLastBatch];
+    batch.pixmap = pixmap;
+    return batch;
 }
@@ -66,6 +66,12 @@ public:
 
     virtual ~MapRenderer() {}
 
+    /**
+     * Creates a renderer for the orientation of the given \a map. The caller
+     * takes ownership of the renderer.
+     */
+    static MapRenderer *create(const Map *map);
+
     /**
      * Returns the map this renderer is associated with.
      */
@@ -259,7 +265,20 @@ public:
         BottomCenter
     };
 
-    explicit CellRenderer(QPainter *painter);
+    enum Ordering {
+        /**
+         * Cells are drawn in the order in which they are rendered.
+         */
+        KeepOrder,
+
+        /**
+         * The cells rendered between two flushes do not overlap, so they
+         * may be drawn grouped by pixmap.
+         */
+        AllowReordering
+    };
+
+    explicit CellRenderer(QPainter *painter, Ordering ordering = KeepOrder);
 
     ~CellRenderer() { flush(); }
 
@@ -267,9 +286,19 @@ public:
     void flush();
 
 private:
+    struct Batch
+    {
+        QPixmap pixmap;
+        QVector<QPainter::PixmapFragment> fragments;
+    };
+
+    Batch &batchFor(const QPixmap &pixmap);
+
     QPainter * const mPainter;
-    Tile *mTile;
-    QVector<QPainter::PixmapFragment> mFragments;
+    const Ordering mOrdering;
+    QVector<Batch> mBatches;
+    int mBatchCount;
+    int mLastBatch;
     const bool mIsOpenGL;
 };
 
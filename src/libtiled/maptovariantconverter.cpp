@@ -21,6 +21,7 @@
 
 #include "maptovariantconverter.h"
 
+#include "compression.h"
 #include "imagelayer.h"
 #include "map.h"
 #include "mapobject.h"
@@ -37,6 +38,9 @@ QVariant MapToVariantConverter::toVariant(const Map *map, const QDir &mapDir)
 {
     mMapDir = mapDir;
     mGidMapper.clear();
+    mError.clear();
+    mLayerDataFormat = map->layerDataFormat();
+    mCompressionLevel = map->compressionLevel();
 
     QVariantMap mapVariant;
 
@@ -54,6 +58,9 @@ QVariant MapToVariantConverter::toVariant(const Map *map, const QDir &mapDir)
         mapVariant[QLatin1String("hexsidelength")] = map->hexSideLength();
     }
 
+    if (map->compressionLevel() != -1)
+        mapVariant[QLatin1String("compressionlevel")] = map->compressionLevel();
+
     if (map->orientation() == Map::Hexagonal || map->orientation() == Map::Staggered) {
         mapVariant[QLatin1String("staggeraxis")] = staggerAxisToString(map->staggerAxis());
         mapVariant[QLatin1String("staggerindex")] = staggerIndexToString(map->staggerIndex());
@@ -76,9 +83,14 @@ QVariant MapToVariantConverter::toVariant(const Map *map, const QDir &mapDir)
     QVariantList layerVariants;
     foreach (const Layer *layer, map->layers()) {
         switch (layer->layerType()) {
-        case Layer::TileLayerType:
-            layerVariants << toVariant(static_cast<const TileLayer*>(layer));
+        case Layer::TileLayerType: {
+            const QVariant tileLayerVariant =
+                    toVariant(static_cast<const TileLayer*>(layer));
+            if (!tileLayerVariant.isValid())
+                return QVariant();
+            layerVariants << tileLayerVariant;
             break;
+        }
         case Layer::ObjectGroupType:
             layerVariants << toVariant(static_cast<const ObjectGroup*>(layer));
             break;
@@ -203,19 +215,70 @@ QVariant MapToVariantConverter::toVariant(const Properties &properties) const
     return variantMap;
 }
 
-QVariant MapToVariantConverter::toVariant(const TileLayer *tileLayer) const
+QVariant MapToVariantConverter::toVariant(const TileLayer *tileLayer)
 {
     QVariantMap tileLayerVariant;
     tileLayerVariant[QLatin1String("type")] = QLatin1String("tilelayer");
 
     addLayerAttributes(tileLayerVariant, tileLayer);
 
-    QVariantList tileVariants;
-    for (int y = 0; y < tileLayer->height(); ++y)
-        for (int x = 0; x < tileLayer->width(); ++x)
-            tileVariants << mGidMapper.cellToGid(tileLayer->cellAt(x, y));
+    // The XML and CSV formats are both stored as an array of global tile IDs
+    if (mLayerDataFormat == Map::XML || mLayerDataFormat == Map::CSV) {
+        QVariantList tileVariants;
+        for (int y = 0; y < tileLayer->height(); ++y)
+            for (int x = 0; x < tileLayer->width(); ++x)
+                tileVariants << mGidMapper.cellToGid(tileLayer->cellAt(x, y));
+
+        tileLayerVariant[QLatin1String("data")] = tileVariants;
+        return tileLayerVariant;
+    }
+
+    QByteArray tileData;
+    tileData.reserve(tileLayer->height() * tileLayer->width() * 4);
+
+    for (int y = 0; y < tileLayer->height(); ++y) {
+        for (int x = 0; x < tileLayer->width(); ++x) {
+            const unsigned gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
+            tileData.append((char) (gid));
+            tileData.append((char) (gid >> 8));
+            tileData.append((char) (gid >> 16));
+            tileData.append((char) (gid >> 24));
+        }
+    }
+
+    QString compression;
+
+    switch (mLayerDataFormat) {
+    case Map::Base64Gzip:
+        compression = QLatin1String("gzip");
+        tileData = compress(tileData, Gzip, mCompressionLevel);
+        break;
+    case Map::Base64Zlib:
+        compression = QLatin1String("zlib");
+        tileData = compress(tileData, Zlib, mCompressionLevel);
+        break;
+    case Map::Base64Zstd:
+        compression = QLatin1String("zstd");
+        tileData = compress(tileData, Zstd, mCompressionLevel);
+        break;
+    case Map::Base64Lz4:
+        compression = QLatin1String("lz4");
+        tileData = compress(tileData, Lz4, mCompressionLevel);
+        break;
+    default:
+        break;
+    }
+
+    if (!compression.isEmpty() && tileData.isNull()) {
+        mError = tr("Failed to compress layer data");
+        return QVariant();
+    }
+
+    tileLayerVariant[QLatin1String("encoding")] = QLatin1String("base64");
+    if (!compression.isEmpty())
+        tileLayerVariant[QLatin1String("compression")] = compression;
+    tileLayerVariant[QLatin1String("data")] = QString::fromLatin1(tileData.toBase64());
 
-    tileLayerVariant[QLatin1String("data")] = tileVariants;
     return tileLayerVariant;
 }
 
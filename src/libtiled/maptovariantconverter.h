@@ -22,10 +22,12 @@
 #ifndef MAPTOVARIANTCONVERTER_H
 #define MAPTOVARIANTCONVERTER_H
 
+#include <QCoreApplication>
 #include <QDir>
 #include <QVariant>
 
 #include "gidmapper.h"
+#include "map.h"
 
 namespace Tiled {
 
@@ -35,19 +37,33 @@ namespace Tiled {
  */
 class TILEDSHARED_EXPORT MapToVariantConverter
 {
+    // Using the MapReader context since the messages are the same
+    Q_DECLARE_TR_FUNCTIONS(MapReader)
+
 public:
-    MapToVariantConverter() {}
+    MapToVariantConverter()
+        : mLayerDataFormat(Map::CSV)
+        , mCompressionLevel(-1)
+    {}
 
     /**
      * Converts the given \s map to a QVariant. The \a mapDir is used to
      * construct relative paths to external resources.
+     *
+     * Returns an invalid QVariant in case of an error. The error can be
+     * obtained using errorString().
      */
     QVariant toVariant(const Map *map, const QDir &mapDir);
 
+    /**
+     * Returns the last error, if any.
+     */
+    QString errorString() const { return mError; }
+
 private:
     QVariant toVariant(const Tileset *tileset, int firstGid) const;
     QVariant toVariant(const Properties &properties) const;
-    QVariant toVariant(const TileLayer *tileLayer) const;
+    QVariant toVariant(const TileLayer *tileLayer);
     QVariant toVariant(const ObjectGroup *objectGroup) const;
     QVariant toVariant(const ImageLayer *imageLayer) const;
 
@@ -56,6 +72,9 @@ private:
 
     QDir mMapDir;
     GidMapper mGidMapper;
+    Map::LayerDataFormat mLayerDataFormat;
+    int mCompressionLevel;
+    QString mError;
 };
 
 } // namespace Tiled
@@ -46,6 +46,7 @@
 #include <QDir>
 #include <QSaveFile>
 #include <QXmlStreamWriter>
+#include <QtConcurrentRun>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -60,23 +61,40 @@ class MapWriterPrivate
 public:
     MapWriterPrivate();
 
-    void writeMap(const Map *map, QIODevice *device,
+    bool writeMap(const Map *map, QIODevice *device,
                   const QString &path);
 
-    void writeTileset(const Tileset &tileset, QIODevice *device,
+    bool writeTileset(const Tileset &tileset, QIODevice *device,
                       const QString &path);
 
     bool openFile(QIODevice *file);
 
     QString mError;
     Map::LayerDataFormat mLayerDataFormat;
+    int mCompressionLevel;
     bool mDtdEnabled;
+    bool mChunkedLayerDataEnabled;
 
 private:
-    void writeMap(QXmlStreamWriter &w, const Map *map);
+    struct LayerData {
+        LayerData() : compressionFailed(false) {}
+
+        QVector<QRect> areas;               // The areas of the layer to write
+        QVector<QByteArray> compressedData; // The compressed data per area
+        bool compressionFailed;
+    };
+
+    bool writeMap(QXmlStreamWriter &w, const Map *map);
     void writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
                       unsigned firstGid);
-    void writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer);
+    void writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer,
+                        const LayerData &layerData);
+    void writeLayerData(QXmlStreamWriter &w, const TileLayer *tileLayer,
+                        const QRect &area, const QByteArray &compressedData,
+                        int depth);
+    LayerData prepareLayerData(const TileLayer *tileLayer) const;
+    QByteArray compressLayerData(const TileLayer *tileLayer,
+                                 const QRect &area) const;
     void writeLayerAttributes(QXmlStreamWriter &w, const Layer *layer);
     void writeObjectGroup(QXmlStreamWriter &w, const ObjectGroup *objectGroup);
     void writeObject(QXmlStreamWriter &w, const MapObject *mapObject);
@@ -95,7 +113,9 @@ private:
 
 MapWriterPrivate::MapWriterPrivate()
     : mLayerDataFormat(Map::Base64Zlib)
+    , mCompressionLevel(-1)
     , mDtdEnabled(false)
+    , mChunkedLayerDataEnabled(false)
     , mUseAbsolutePaths(false)
 {
 }
@@ -118,12 +138,165 @@ static QXmlStreamWriter *createWriter(QIODevice *device)
     return writer;
 }
 
-void MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
+namespace {
+
+bool isCompressed(Map::LayerDataFormat format)
+{
+    switch (format) {
+    case Map::Base64Gzip:
+    case Map::Base64Zlib:
+    case Map::Base64Zstd:
+    case Map::Base64Lz4:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The size of the blocks in which layer data is formatted and written
+const int blockSize = 16 * 1024;
+
+/**
+ * Calls \a process with the global tile IDs in the given \a area of the
+ * layer in little endian byte order, in blocks of at most blockSize bytes.
+ */
+template <typename Process>
+void forEachGidBlock(const GidMapper &gidMapper, const TileLayer *tileLayer,
+                     const QRect &area, Process process)
+{
+    char block[blockSize];
+    char *out = block;
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+            if (out == block + blockSize) {
+                process(block, blockSize);
+                out = block;
+            }
+
+            const unsigned gid = gidMapper.cellToGid(tileLayer->cellAt(x, y));
+            *out++ = char(gid);
+            *out++ = char(gid >> 8);
+            *out++ = char(gid >> 16);
+            *out++ = char(gid >> 24);
+        }
+    }
+
+    if (out != block)
+        process(block, int(out - block));
+}
+
+/**
+ * Writes \a value in decimal to \a out, which needs room for 10 characters.
+ * Returns the number of characters written.
+ */
+int formatUnsigned(unsigned value, char *out)
+{
+    char digits[10];
+    int count = 0;
+
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    for (int i = 0; i < count; ++i)
+        out[i] = digits[count - 1 - i];
+
+    return count;
+}
+
+/**
+ * Encodes data as base64 and writes it to a device in blocks, so that the
+ * encoded text never has to be held in memory as a whole.
+ */
+class Base64Writer
+{
+public:
+    explicit Base64Writer(QIODevice *device)
+        : mDevice(device)
+        , mGroupLength(0)
+        , mLength(0)
+    {}
+
+    void write(const char *data, int length)
+    {
+        const uchar *in = reinterpret_cast<const uchar*>(data);
+        const uchar *end = in + length;
+
+        while (in != end) {
+            mGroup[mGroupLength++] = *in++;
+            if (mGroupLength == 3) {
+                writeGroup();
+                mGroupLength = 0;
+            }
+        }
+    }
+
+    /**
+     * Writes any remaining bytes with padding and flushes the buffer.
+     */
+    void finish()
+    {
+        if (mGroupLength > 0) {
+            writeGroup();
+            mGroupLength = 0;
+        }
+
+        mDevice->write(mBuffer, mLength);
+        mLength = 0;
+    }
+
+private:
+    void writeGroup()
+    {
+        static const char alphabet[] =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        if (mLength + 4 > blockSize) {
+            mDevice->write(mBuffer, mLength);
+            mLength = 0;
+        }
+
+        const unsigned value = (mGroup[0] << 16) |
+                (mGroupLength > 1 ? mGroup[1] << 8 : 0) |
+                (mGroupLength > 2 ? mGroup[2] : 0);
+
+        char *out = mBuffer + mLength;
+        out[0] = alphabet[(value >> 18) & 63];
+        out[1] = alphabet[(value >> 12) & 63];
+        out[2] = mGroupLength > 1 ? alphabet[(value >> 6) & 63] : '=';
+        out[3] = mGroupLength > 2 ? alphabet[value & 63] : '=';
+        mLength += 4;
+    }
+
+    QIODevice *mDevice;
+    uchar mGroup[3];
+    int mGroupLength;
+    char mBuffer[blockSize];
+    int mLength;
+};
+
+} // anonymous namespace
+
+bool MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
                                 const QString &path)
 {
+    mError.clear();
     mMapDir = QDir(path);
     mUseAbsolutePaths = path.isEmpty();
     mLayerDataFormat = map->layerDataFormat();
+    mCompressionLevel = map->compressionLevel();
+
+    // Lazily loaded layers are decoded before writing anything, since a
+    // layer that failed to decode would otherwise be written empty. This
+    // also can't happen on the threads compressing the layers, since it
+    // updates the draw margins of the map.
+    const QString decodeError = const_cast<Map*>(map)->decodeLayerData();
+    if (!decodeError.isEmpty()) {
+        mError = decodeError;
+        return false;
+    }
 
     QXmlStreamWriter *writer = createWriter(device);
     writer->writeStartDocument();
@@ -134,14 +307,18 @@ void MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
                                        "map.dtd\">"));
     }
 
-    writeMap(*writer, map);
-    writer->writeEndDocument();
+    const bool success = writeMap(*writer, map);
+    if (success)
+        writer->writeEndDocument();
     delete writer;
+
+    return success;
 }
 
-void MapWriterPrivate::writeTileset(const Tileset &tileset, QIODevice *device,
+bool MapWriterPrivate::writeTileset(const Tileset &tileset, QIODevice *device,
                                     const QString &path)
 {
+    mError.clear();
     mMapDir = QDir(path);
     mUseAbsolutePaths = path.isEmpty();
 
@@ -156,10 +333,16 @@ void MapWriterPrivate::writeTileset(const Tileset &tileset, QIODevice *device,
 
     writeTileset(*writer, &tileset, 0);
     writer->writeEndDocument();
+
+    const bool success = !writer->hasError();
+    if (!success)
+        mError = tr("Could not write the tileset.");
+
     delete writer;
+    return success;
 }
 
-void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
+bool MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
 {
     w.writeStartElement(QLatin1String("map"));
 
@@ -193,6 +376,11 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
                          map->backgroundColor().name());
     }
 
+    if (map->compressionLevel() != -1) {
+        w.writeAttribute(QLatin1String("compressionlevel"),
+                         QString::number(map->compressionLevel()));
+    }
+
     w.writeAttribute(QLatin1String("nextobjectid"),
                      QString::number(map->nextObjectId()));
 
@@ -206,17 +394,49 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
         firstGid += tileset->tileCount();
     }
 
+    // Compressing the tile layer data is the expensive part of saving a map,
+    // so it is done for all layers concurrently. The results are then
+    // written in layer order.
+    QList<QFuture<LayerData> > preparedLayerData;
+    if (isCompressed(mLayerDataFormat)) {
+        foreach (const Layer *layer, map->layers()) {
+            if (layer->layerType() != Layer::TileLayerType)
+                continue;
+
+            const TileLayer *tileLayer = static_cast<const TileLayer*>(layer);
+            preparedLayerData.append(QtConcurrent::run([=] {
+                return prepareLayerData(tileLayer);
+            }));
+        }
+    }
+
     foreach (const Layer *layer, map->layers()) {
         const Layer::TypeFlag type = layer->layerType();
-        if (type == Layer::TileLayerType)
-            writeTileLayer(w, static_cast<const TileLayer*>(layer));
-        else if (type == Layer::ObjectGroupType)
+        if (type == Layer::TileLayerType) {
+            const TileLayer *tileLayer = static_cast<const TileLayer*>(layer);
+            const LayerData layerData = preparedLayerData.isEmpty() ?
+                        prepareLayerData(tileLayer) :
+                        preparedLayerData.takeFirst().result();
+
+            if (layerData.compressionFailed) {
+                // The other layers still refer to this writer
+                foreach (QFuture<LayerData> future, preparedLayerData)
+                    future.waitForFinished();
+
+                mError = tr("Failed to compress layer data");
+                return false;
+            }
+
+            writeTileLayer(w, tileLayer, layerData);
+        } else if (type == Layer::ObjectGroupType) {
             writeObjectGroup(w, static_cast<const ObjectGroup*>(layer));
-        else if (type == Layer::ImageLayerType)
+        } else if (type == Layer::ImageLayerType) {
             writeImageLayer(w, static_cast<const ImageLayer*>(layer));
+        }
     }
 
     w.writeEndElement();
+    return true;
 }
 
 static QString makeTerrainAttribute(const Tile *tile)
@@ -389,8 +609,13 @@ void MapWriterPrivate::writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
     w.writeEndElement();
 }
 
+/**
+ * Writes the given tile layer. The \a layerData is the data returned by
+ * prepareLayerData().
+ */
 void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
-                                      const TileLayer *tileLayer)
+                                      const TileLayer *tileLayer,
+                                      const LayerData &layerData)
 {
     w.writeStartElement(QLatin1String("layer"));
     writeLayerAttributes(w, tileLayer);
@@ -399,19 +624,32 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
     QString encoding;
     QString compression;
 
-    if (mLayerDataFormat == Map::Base64
-            || mLayerDataFormat == Map::Base64Gzip
-            || mLayerDataFormat == Map::Base64Zlib) {
-
-        encoding = QLatin1String("base64");
-
-        if (mLayerDataFormat == Map::Base64Gzip)
-            compression = QLatin1String("gzip");
-        else if (mLayerDataFormat == Map::Base64Zlib)
-            compression = QLatin1String("zlib");
-
-    } else if (mLayerDataFormat == Map::CSV)
+    switch (mLayerDataFormat) {
+    case Map::XML:
+        break;
+    case Map::CSV:
         encoding = QLatin1String("csv");
+        break;
+    case Map::Base64:
+        encoding = QLatin1String("base64");
+        break;
+    case Map::Base64Gzip:
+        encoding = QLatin1String("base64");
+        compression = QLatin1String("gzip");
+        break;
+    case Map::Base64Zlib:
+        encoding = QLatin1String("base64");
+        compression = QLatin1String("zlib");
+        break;
+    case Map::Base64Zstd:
+        encoding = QLatin1String("base64");
+        compression = QLatin1String("zstd");
+        break;
+    case Map::Base64Lz4:
+        encoding = QLatin1String("base64");
+        compression = QLatin1String("lz4");
+        break;
+    }
 
     w.writeStartElement(QLatin1String("data"));
     if (!encoding.isEmpty())
@@ -419,9 +657,47 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
     if (!compression.isEmpty())
         w.writeAttribute(QLatin1String("compression"), compression);
 
+    for (int i = 0; i < layerData.areas.size(); ++i) {
+        const QRect &area = layerData.areas.at(i);
+        const QByteArray compressedData = layerData.compressedData.value(i);
+
+        if (!mChunkedLayerDataEnabled) {
+            writeLayerData(w, tileLayer, area, compressedData, 3);
+            continue;
+        }
+
+        w.writeStartElement(QLatin1String("chunk"));
+        w.writeAttribute(QLatin1String("x"), QString::number(area.x()));
+        w.writeAttribute(QLatin1String("y"), QString::number(area.y()));
+        w.writeAttribute(QLatin1String("width"), QString::number(area.width()));
+        w.writeAttribute(QLatin1String("height"), QString::number(area.height()));
+        writeLayerData(w, tileLayer, area, compressedData, 4);
+        w.writeEndElement(); // </chunk>
+    }
+
+    w.writeEndElement(); // </data>
+    w.writeEndElement(); // </layer>
+}
+
+/**
+ * Writes the cells in \a area of the given tile layer as the contents of a
+ * <data> or <chunk> element, nested at the given \a depth. For the
+ * compressed layer data formats, \a compressedData is the data returned by
+ * compressLayerData().
+ *
+ * CSV and base64 encoded layer data is written straight to the device in
+ * blocks, bypassing the XML writer. This avoids building the text of large
+ * layers in memory, which is safe since it never needs escaping.
+ */
+void MapWriterPrivate::writeLayerData(QXmlStreamWriter &w,
+                                      const TileLayer *tileLayer,
+                                      const QRect &area,
+                                      const QByteArray &compressedData,
+                                      int depth)
+{
     if (mLayerDataFormat == Map::XML) {
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            for (int x = area.left(); x <= area.right(); ++x) {
                 const unsigned gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
                 w.writeStartElement(QLatin1String("tile"));
                 w.writeAttribute(QLatin1String("gid"), QString::number(gid));
@@ -429,47 +705,117 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
             }
         }
     } else if (mLayerDataFormat == Map::CSV) {
-        QString tileData;
+        // Also makes the writer close the start tag of the data element
+        w.writeCharacters(QLatin1String("\n"));
+
+        QIODevice *device = w.device();
+        char buffer[blockSize];
+        int length = 0;
+
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            for (int x = area.left(); x <= area.right(); ++x) {
+                // Room for a number, a comma and a newline
+                if (length + 12 > blockSize) {
+                    device->write(buffer, length);
+                    length = 0;
+                }
 
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
                 const unsigned gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append(QString::number(gid));
-                if (x != tileLayer->width() - 1
-                    || y != tileLayer->height() - 1)
-                    tileData.append(QLatin1String(","));
+                length += formatUnsigned(gid, buffer + length);
+                if (x != area.right() || y != area.bottom())
+                    buffer[length++] = ',';
             }
-            tileData.append(QLatin1String("\n"));
+            buffer[length++] = '\n';
         }
 
-        w.writeCharacters(QLatin1String("\n"));
-        w.writeCharacters(tileData);
+        device->write(buffer, length);
+
+        if (depth > 3)
+            w.writeCharacters(QString(depth - 1, QLatin1Char(' ')));
     } else {
-        QByteArray tileData;
-        tileData.reserve(tileLayer->height() * tileLayer->width() * 4);
+        w.writeCharacters(QLatin1String("\n") + QString(depth, QLatin1Char(' ')));
 
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
-                const unsigned gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append((char) (gid));
-                tileData.append((char) (gid >> 8));
-                tileData.append((char) (gid >> 16));
-                tileData.append((char) (gid >> 24));
-            }
+        Base64Writer base64Writer(w.device());
+
+        if (isCompressed(mLayerDataFormat)) {
+            base64Writer.write(compressedData.constData(),
+                               compressedData.size());
+        } else {
+            forEachGidBlock(mGidMapper, tileLayer, area,
+                            [&] (const char *data, int length) {
+                base64Writer.write(data, length);
+            });
         }
 
-        if (mLayerDataFormat == Map::Base64Gzip)
-            tileData = compress(tileData, Gzip);
-        else if (mLayerDataFormat == Map::Base64Zlib)
-            tileData = compress(tileData, Zlib);
+        base64Writer.finish();
 
-        w.writeCharacters(QLatin1String("\n   "));
-        w.writeCharacters(QString::fromLatin1(tileData.toBase64()));
-        w.writeCharacters(QLatin1String("\n  "));
+        w.writeCharacters(QLatin1String("\n") + QString(depth - 1, QLatin1Char(' ')));
     }
+}
 
-    w.writeEndElement(); // </data>
-    w.writeEndElement(); // </layer>
+/**
+ * Determines the areas of the given tile layer to write, and compresses
+ * their data when required by the layer data format. Without chunks, the
+ * whole layer is a single area.
+ *
+ * Does not touch the writer, so that it can be called for several layers in
+ * parallel.
+ */
+MapWriterPrivate::LayerData MapWriterPrivate::prepareLayerData(const TileLayer *tileLayer) const
+{
+    LayerData layerData;
+
+    if (mChunkedLayerDataEnabled)
+        layerData.areas = tileLayer->nonEmptyChunkRects();
+    else
+        layerData.areas.append(QRect(0, 0, tileLayer->width(), tileLayer->height()));
+
+    if (isCompressed(mLayerDataFormat)) {
+        layerData.compressedData.reserve(layerData.areas.size());
+        foreach (const QRect &area, layerData.areas) {
+            const QByteArray compressed = compressLayerData(tileLayer, area);
+            if (compressed.isNull()) {
+                layerData.compressionFailed = true;
+                break;
+            }
+            layerData.compressedData.append(compressed);
+        }
+    }
+
+    return layerData;
+}
+
+/**
+ * Returns the global tile IDs in the given \a area of the tile layer,
+ * compressed as required by the layer data format. Returns a null byte
+ * array when compression failed.
+ *
+ * The IDs are compressed in blocks, so only the compressed data is held in
+ * memory as a whole.
+ */
+QByteArray MapWriterPrivate::compressLayerData(const TileLayer *tileLayer,
+                                               const QRect &area) const
+{
+    CompressionMethod method = Zlib;
+    if (mLayerDataFormat == Map::Base64Gzip)
+        method = Gzip;
+    else if (mLayerDataFormat == Map::Base64Zstd)
+        method = Zstd;
+    else if (mLayerDataFormat == Map::Base64Lz4)
+        method = Lz4;
+
+    Compressor compressor(method, mCompressionLevel);
+    QByteArray compressed;
+
+    forEachGidBlock(mGidMapper, tileLayer, area,
+                    [&] (const char *data, int length) {
+        compressor.compress(data, length, compressed);
+    });
+
+    if (!compressor.finish(compressed))
+        return QByteArray();
+
+    return compressed;
 }
 
 void MapWriterPrivate::writeLayerAttributes(QXmlStreamWriter &w,
@@ -647,10 +993,10 @@ MapWriter::~MapWriter()
     delete d;
 }
 
-void MapWriter::writeMap(const Map *map, QIODevice *device,
+bool MapWriter::writeMap(const Map *map, QIODevice *device,
                          const QString &path)
 {
-    d->writeMap(map, device, path);
+    return d->writeMap(map, device, path);
 }
 
 bool MapWriter::writeMap(const Map *map, const QString &fileName)
@@ -659,7 +1005,8 @@ bool MapWriter::writeMap(const Map *map, const QString &fileName)
     if (!d->openFile(&file))
         return false;
 
-    writeMap(map, &file, QFileInfo(fileName).absolutePath());
+    if (!writeMap(map, &file, QFileInfo(fileName).absolutePath()))
+        return false;
 
     if (file.error() != QFile::NoError) {
         d->mError = file.errorString();
@@ -674,10 +1021,10 @@ bool MapWriter::writeMap(const Map *map, const QString &fileName)
     return true;
 }
 
-void MapWriter::writeTileset(const Tileset &tileset, QIODevice *device,
+bool MapWriter::writeTileset(const Tileset &tileset, QIODevice *device,
                              const QString &path)
 {
-    d->writeTileset(tileset, device, path);
+    return d->writeTileset(tileset, device, path);
 }
 
 bool MapWriter::writeTileset(const Tileset &tileset, const QString &fileName)
@@ -686,7 +1033,8 @@ bool MapWriter::writeTileset(const Tileset &tileset, const QString &fileName)
     if (!d->openFile(&file))
         return false;
 
-    writeTileset(tileset, &file, QFileInfo(fileName).absolutePath());
+    if (!writeTileset(tileset, &file, QFileInfo(fileName).absolutePath()))
+        return false;
 
     if (file.error() != QFile::NoError) {
         d->mError = file.errorString();
@@ -710,3 +1058,13 @@ bool MapWriter::isDtdEnabled() const
 {
     return d->mDtdEnabled;
 }
+
+void MapWriter::setChunkedLayerDataEnabled(bool enabled)
+{
+    d->mChunkedLayerDataEnabled = enabled;
+}
+
+bool MapWriter::isChunkedLayerDataEnabled() const
+{
+    return d->mChunkedLayerDataEnabled;
+}
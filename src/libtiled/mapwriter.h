@@ -60,10 +60,11 @@ public:
      * be given, which will be used to create relative references to external
      * images and tilesets.
      *
-     * Error checking will need to be done on the \a device after calling this
-     * function.
+     * Returns false and sets errorString() when the layer data could not be
+     * decoded or compressed. Error checking will need to be done on the
+     * \a device after calling this function.
      */
-    void writeMap(const Map *map, QIODevice *device,
+    bool writeMap(const Map *map, QIODevice *device,
                   const QString &path = QString());
 
     /**
@@ -79,10 +80,10 @@ public:
      * be given, which will be used to create relative references to external
      * images.
      *
-     * Error checking will need to be done on the \a device after calling this
-     * function.
+     * Returns false and sets errorString() when writing to the \a device
+     * failed.
      */
-    void writeTileset(const Tileset &tileset, QIODevice *device,
+    bool writeTileset(const Tileset &tileset, QIODevice *device,
                       const QString &path = QString());
 
     /**
@@ -104,6 +105,14 @@ public:
     void setDtdEnabled(bool enabled);
     bool isDtdEnabled() const;
 
+    /**
+     * Sets whether tile layer data is written in chunks. Only the chunks
+     * that contain tiles are written, which makes sparse layers a lot
+     * smaller. Disabled by default.
+     */
+    void setChunkedLayerDataEnabled(bool enabled);
+    bool isChunkedLayerDataEnabled() const;
+
 private:
     Internal::MapWriterPrivate *d;
 };
@@ -64,7 +64,7 @@ QRectF OrthogonalRenderer::boundingRect(const MapObject *object) const
     if (!object->cell().isEmpty()) {
         const QPointF bottomLeft = bounds.topLeft();
         const Tile *tile = object->cell().tile;
-        const QSize imgSize = tile->image().size();
+        const QSize imgSize = tile->size();
         const QPoint tileOffset = tile->offset();
         const QSizeF objectSize = object->size();
         const QSizeF scale(objectSize.width() / imgSize.width(), objectSize.height() / imgSize.height());
@@ -236,7 +236,18 @@ void OrthogonalRenderer::drawTileLayer(QPainter *painter,
     if (startX > endX || startY > endY)
         return;
 
-    CellRenderer renderer(painter);
+    // When the tiles fit within their cells, they don't overlap and can be
+    // drawn grouped by tileset. When they are only taller, tiles only
+    // overlap those in other rows, so they can be grouped within each row.
+    const QMargins drawMargins = layer->drawMargins();
+    const bool fitsWidth = drawMargins.left() <= 0 &&
+            drawMargins.right() <= tileWidth;
+    const bool fitsHeight = drawMargins.bottom() <= 0 &&
+            drawMargins.top() <= tileHeight;
+    const bool flushEachRow = fitsWidth && !fitsHeight;
+
+    CellRenderer renderer(painter, fitsWidth ? CellRenderer::AllowReordering
+                                             : CellRenderer::KeepOrder);
 
     Map::RenderOrder renderOrder = map()->renderOrder();
 
@@ -275,6 +286,9 @@ void OrthogonalRenderer::drawTileLayer(QPainter *painter,
                             QSizeF(0, 0),
                             CellRenderer::BottomLeft);
         }
+
+        if (flushEachRow)
+            renderer.flush();
     }
 
     renderer.flush();
@@ -0,0 +1,102 @@
+/*
+ * regionbuilder.cpp
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "regionbuilder.h"
+
+using namespace Tiled;
+
+RegionBuilder::RegionBuilder()
+    : mRowY(0)
+    , mBandStart(-1)
+{
+}
+
+void RegionBuilder::addSpan(int x, int y, int width)
+{
+    if (width <= 0)
+        return;
+
+    if (y != mRowY && !mRow.isEmpty())
+        finishRow();
+
+    Q_ASSERT(mRow.isEmpty() || y == mRowY);
+    Q_ASSERT(mRects.isEmpty() || y > mRects.last().bottom());
+
+    mRowY = y;
+
+    // Spans touching the previous one are joined, since QRegion does not
+    // allow rectangles within a band to be adjacent.
+    if (!mRow.isEmpty() && mRow.last().right() + 1 >= x) {
+        Q_ASSERT(x > mRow.last().left());
+        QRect &last = mRow.last();
+        last.setRight(qMax(last.right(), x + width - 1));
+        return;
+    }
+
+    mRow.append(QRect(x, y, width, 1));
+}
+
+QRegion RegionBuilder::region()
+{
+    if (!mRow.isEmpty())
+        finishRow();
+
+    QRegion region;
+    region.setRects(mRects.constData(), mRects.size());
+    return region;
+}
+
+/**
+ * Moves the spans of the current row into the list of rectangles. When the
+ * row directly follows a band with exactly the same spans, that band is
+ * extended instead.
+ */
+void RegionBuilder::finishRow()
+{
+    const int bandSize = mRects.size() - mBandStart;
+    bool extendBand = mBandStart != -1
+            && bandSize == mRow.size()
+            && mRects.last().bottom() == mRowY - 1;
+
+    for (int i = 0; extendBand && i < bandSize; ++i) {
+        const QRect &bandRect = mRects.at(mBandStart + i);
+        const QRect &rowRect = mRow.at(i);
+        extendBand = bandRect.left() == rowRect.left()
+                && bandRect.right() == rowRect.right();
+    }
+
+    if (extendBand) {
+        for (int i = mBandStart; i < mRects.size(); ++i)
+            mRects[i].setBottom(mRowY);
+    } else {
+        mBandStart = mRects.size();
+        mRects += mRow;
+    }
+
+    mRow.resize(0);
+}
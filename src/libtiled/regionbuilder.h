@@ -0,0 +1,78 @@
+/*
+ * regionbuilder.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILED_REGIONBUILDER_H
+#define TILED_REGIONBUILDER_H
+
+#include "tiled_global.h"
+
+#include <QRect>
+#include <QRegion>
+#include <QVector>
+
+namespace Tiled {
+
+/**
+ * Builds a QRegion from horizontal spans in a single pass.
+ *
+ * Uniting a QRegion with one rectangle at a time is linear in the number of
+ * rectangles already in the region, which makes building a fragmented region
+ * quadratic. This class instead collects the spans into the banded list of
+ * rectangles used internally by QRegion, merging identical consecutive rows,
+ * and constructs the region once at the end.
+ *
+ * Spans need to be added row by row from top to bottom, and from left to
+ * right within each row.
+ */
+class TILEDSHARED_EXPORT RegionBuilder
+{
+public:
+    RegionBuilder();
+
+    /**
+     * Adds the span of \a width cells starting at (\a x, \a y).
+     */
+    void addSpan(int x, int y, int width);
+
+    /**
+     * Returns the region made up of all the added spans.
+     */
+    QRegion region();
+
+private:
+    void finishRow();
+
+    QVector<QRect> mRects;
+    QVector<QRect> mRow;
+    int mRowY;
+    int mBandStart;
+};
+
+} // namespace Tiled
+
+#endif // TILED_REGIONBUILDER_H
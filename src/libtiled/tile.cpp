@@ -40,6 +40,7 @@ Tile::Tile(const QPixmap &image,
     mId(id),
     mTileset(tileset),
     mImage(image),
+    mImageRect(image.rect()),
     mTerrain(-1),
     mTerrainProbability(1.f),
     mObjectGroup(0),
@@ -55,6 +56,7 @@ Tile::Tile(const QPixmap &image,
     mId(id),
     mTileset(tileset),
     mImage(image),
+    mImageRect(image.rect()),
     mImageSource(imageSource),
     mTerrain(-1),
     mTerrainProbability(1.f),
@@ -77,16 +79,29 @@ QSharedPointer<Tileset> Tile::sharedTileset() const
 }
 
 /**
- * Returns the image for rendering this tile, taking into account tile
- * animations.
+ * Returns the image of this tile. For tiles sharing an atlas pixmap, this
+ * returns a copy of their part of it, so views that draw many tiles should
+ * use atlasPixmap() and imageRect() instead.
  */
-const QPixmap &Tile::currentFrameImage() const
+QPixmap Tile::image() const
+{
+    if (mImageRect == mImage.rect())
+        return mImage;
+
+    return mImage.copy(mImageRect);
+}
+
+/**
+ * Returns the tile whose image should be used for rendering this tile,
+ * taking into account tile animations.
+ */
+const Tile *Tile::currentFrameTile() const
 {
     if (isAnimated()) {
         const Frame &frame = mFrames.at(mCurrentFrameIndex);
-        return mTileset->tileAt(frame.tileId)->image();
+        return mTileset->tileAt(frame.tileId);
     } else {
-        return mImage;
+        return this;
     }
 }
 
@@ -79,10 +79,14 @@ public:
     Tileset *tileset() const;
     QSharedPointer<Tileset> sharedTileset() const;
 
-    const QPixmap &image() const;
+    QPixmap image() const;
     void setImage(const QPixmap &image);
+    void setImage(const QPixmap &atlas, const QRect &imageRect);
 
-    const QPixmap &currentFrameImage() const;
+    const QPixmap &atlasPixmap() const;
+    const QRect &imageRect() const;
+
+    const Tile *currentFrameTile() const;
 
     const QString &imageSource() const;
     void setImageSource(const QString &imageSource);
@@ -118,6 +122,7 @@ private:
     int mId;
     Tileset *mTileset;
     QPixmap mImage;
+    QRect mImageRect;
     QString mImageSource;
     unsigned mTerrain;
     float mTerrainProbability;
@@ -147,19 +152,44 @@ inline Tileset *Tile::tileset() const
 }
 
 /**
- * Returns the image of this tile.
+ * Sets the image of this tile.
+ */
+inline void Tile::setImage(const QPixmap &image)
+{
+    mImage = image;
+    mImageRect = image.rect();
+}
+
+/**
+ * Sets the image of this tile to the part \a imageRect of the given
+ * \a atlas pixmap. This allows all tiles of a tileset image to share a
+ * single pixmap.
  */
-inline const QPixmap &Tile::image() const
+inline void Tile::setImage(const QPixmap &atlas, const QRect &imageRect)
+{
+    mImage = atlas;
+    mImageRect = imageRect;
+}
+
+/**
+ * Returns the pixmap that contains the image of this tile at imageRect().
+ * For tiles from a tileset image this is the image shared by all its tiles,
+ * otherwise it is the image of this tile alone.
+ *
+ * Renderers should draw this part of the atlas pixmap rather than calling
+ * image(), which needs to copy it.
+ */
+inline const QPixmap &Tile::atlasPixmap() const
 {
     return mImage;
 }
 
 /**
- * Sets the image of this tile.
+ * Returns the part of atlasPixmap() that is the image of this tile.
  */
-inline void Tile::setImage(const QPixmap &image)
+inline const QRect &Tile::imageRect() const
 {
-    mImage = image;
+    return mImageRect;
 }
 
 /**
@@ -182,7 +212,7 @@ inline void Tile::setImageSource(const QString &imageSource)
  */
 inline int Tile::width() const
 {
-    return mImage.width();
+    return mImageRect.width();
 }
 
 /**
@@ -190,7 +220,7 @@ inline int Tile::width() const
  */
 inline int Tile::height() const
 {
-    return mImage.height();
+    return mImageRect.height();
 }
 
 /**
@@ -198,7 +228,7 @@ inline int Tile::height() const
  */
 inline QSize Tile::size() const
 {
-    return mImage.size();
+    return mImageRect.size();
 }
 
 /**
@@ -32,12 +32,233 @@
 #include "map.h"
 #include "tile.h"
 
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace Tiled;
 
+/*
+ * Bulk kernels operating on rows of packed cells. Since packed cells are
+ * plain integers, whole rows can be compared or scanned a vector register at
+ * a time. A scalar loop handles the remaining cells and is used when no SIMD
+ * instructions are available.
+ */
+
+/**
+ * Returns whether the first \a count cells of \a a and \a b are equal.
+ */
+static bool equalCells(const PackedCell *a, const PackedCell *b, int count)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const int perBlock = int(sizeof(__m256i) / sizeof(PackedCell));
+    for (; i + perBlock <= count; i += perBlock) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != -1)
+            return false;
+    }
+#elif defined(__SSE2__)
+    const int perBlock = int(sizeof(__m128i) / sizeof(PackedCell));
+    for (; i + perBlock <= count; i += perBlock) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+            return false;
+    }
+#endif
+
+    for (; i < count; ++i)
+        if (a[i] != b[i])
+            return false;
+
+    return true;
+}
+
+/**
+ * Returns whether the first \a count cells of \a cells are all empty.
+ */
+static bool emptyCells(const PackedCell *cells, int count)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const int perBlock = int(sizeof(__m256i) / sizeof(PackedCell));
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + perBlock <= count; i += perBlock)
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + i)));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, _mm256_setzero_si256())) != -1)
+        return false;
+#elif defined(__SSE2__)
+    const int perBlock = int(sizeof(__m128i) / sizeof(PackedCell));
+    __m128i acc = _mm_setzero_si128();
+    for (; i + perBlock <= count; i += perBlock)
+        acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + i)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+        return false;
+#endif
+
+    for (; i < count; ++i)
+        if (!cells[i].isEmpty())
+            return false;
+
+    return true;
+}
+
+/**
+ * Adds the runs of differing cells among the first \a count cells of \a a
+ * and \a b to the \a builder, as spans starting at (\a x, \a y).
+ */
+static void addDifferingSpans(RegionBuilder &builder,
+                              const PackedCell *a, const PackedCell *b,
+                              int count, int x, int y)
+{
+    for (int i = 0; i < count; ++i) {
+        if (a[i] != b[i]) {
+            const int rangeStart = i;
+            while (i < count && a[i] != b[i])
+                ++i;
+            builder.addSpan(x + rangeStart, y, i - rangeStart);
+        }
+    }
+}
+
+/**
+ * Sets the cell at the given \a index. Allocates the cells of this chunk when
+ * a non-empty cell is set, and releases them again when the last non-empty
+ * cell is removed.
+ */
+void Chunk::setCell(int index, const Cell &cell)
+{
+    Q_ASSERT(index >= 0 && index < CHUNK_SIZE * CHUNK_SIZE);
+
+    const PackedCell packed(cell);
+    const bool empty = packed.isEmpty();
+
+    if (!isAllocated()) {
+        if (empty)
+            return;
+        mGrid.resize(CHUNK_SIZE * CHUNK_SIZE);
+    }
+
+    PackedCell &existing = mGrid[index];
+    if (existing.isEmpty() != empty)
+        mCellCount += empty ? -1 : 1;
+
+    existing = packed;
+
+    if (mCellCount == 0)
+        mGrid = QVector<PackedCell>();
+}
+
+/**
+ * Replaces all cells of this chunk with the CHUNK_SIZE * CHUNK_SIZE \a cells.
+ * The cells are written in place, unless they are shared with another chunk.
+ */
+void Chunk::setCells(const PackedCell *cells)
+{
+    int cellCount = 0;
+    for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; ++i)
+        if (!cells[i].isEmpty())
+            ++cellCount;
+
+    mCellCount = cellCount;
+
+    if (cellCount == 0) {
+        mGrid = QVector<PackedCell>();
+        return;
+    }
+
+    if (!isAllocated())
+        mGrid.resize(CHUNK_SIZE * CHUNK_SIZE);
+
+    std::copy(cells, cells + CHUNK_SIZE * CHUNK_SIZE, mGrid.begin());
+}
+
+static const PackedCell emptyChunkCells[CHUNK_SIZE * CHUNK_SIZE];
+
+/**
+ * Moves all cells in a grid of chunks \a shift cells to the left, where
+ * 0 < \a shift < CHUNK_SIZE. Cells shifted past the left edge are dropped.
+ *
+ * Works in place, one chunk at a time, from left to right so that each chunk
+ * only needs cells from its right neighbor which has not been shifted yet.
+ */
+static void shiftChunksLeft(QVector<Chunk> &chunks, int chunkColumns,
+                            int shift)
+{
+    PackedCell block[CHUNK_SIZE * CHUNK_SIZE];
+    const int kept = CHUNK_SIZE - shift;
+
+    for (int i = 0, i_end = chunks.size(); i < i_end; ++i) {
+        const bool lastColumn = (i % chunkColumns) == chunkColumns - 1;
+        const Chunk &chunk = chunks.at(i);
+        const bool nextAllocated = !lastColumn && chunks.at(i + 1).isAllocated();
+
+        if (!chunk.isAllocated() && !nextAllocated)
+            continue;
+
+        const PackedCell *cells = chunk.isAllocated() ? chunk.constData()
+                                                      : emptyChunkCells;
+        const PackedCell *nextCells = nextAllocated ? chunks.at(i + 1).constData()
+                                                    : emptyChunkCells;
+
+        for (int y = 0; y < CHUNK_SIZE * CHUNK_SIZE; y += CHUNK_SIZE) {
+            std::copy(cells + y + shift, cells + y + CHUNK_SIZE, block + y);
+            std::copy(nextCells + y, nextCells + y + shift, block + y + kept);
+        }
+
+        chunks[i].setCells(block);
+    }
+}
+
+/**
+ * Moves all cells in a grid of chunks \a shift cells up, where
+ * 0 < \a shift < CHUNK_SIZE. Cells shifted past the top edge are dropped.
+ *
+ * Works in place like shiftChunksLeft, from top to bottom.
+ */
+static void shiftChunksUp(QVector<Chunk> &chunks, int chunkColumns,
+                          int shift)
+{
+    PackedCell block[CHUNK_SIZE * CHUNK_SIZE];
+    const int kept = (CHUNK_SIZE - shift) * CHUNK_SIZE;
+
+    for (int i = 0, i_end = chunks.size(); i < i_end; ++i) {
+        const bool lastRow = i + chunkColumns >= i_end;
+        const Chunk &chunk = chunks.at(i);
+        const bool nextAllocated = !lastRow &&
+                chunks.at(i + chunkColumns).isAllocated();
+
+        if (!chunk.isAllocated() && !nextAllocated)
+            continue;
+
+        const PackedCell *cells = chunk.isAllocated() ? chunk.constData()
+                                                      : emptyChunkCells;
+        const PackedCell *nextCells = nextAllocated ?
+                    chunks.at(i + chunkColumns).constData() : emptyChunkCells;
+
+        std::copy(cells + shift * CHUNK_SIZE,
+                  cells + CHUNK_SIZE * CHUNK_SIZE, block);
+        std::copy(nextCells, nextCells + shift * CHUNK_SIZE, block + kept);
+
+        chunks[i].setCells(block);
+    }
+}
+
+
 TileLayer::TileLayer(const QString &name, int x, int y, int width, int height):
     Layer(TileLayerType, name, x, y, width, height),
     mMaxTileSize(0, 0),
-    mGrid(width * height)
+    mChunkColumns(chunkColumnsForWidth(width)),
+    mChunks(mChunkColumns * chunkRowsForHeight(height)),
+    mDecoded(true)
 {
     Q_ASSERT(width >= 0);
     Q_ASSERT(height >= 0);
@@ -59,6 +280,17 @@ static QMargins maxMargins(const QMargins &a,
                     qMax(a.bottom(), b.bottom()));
 }
 
+/**
+ * Sets the cell at (\a x, \a y) in a chunk grid with the given number of
+ * chunk columns. Used when building a new grid for a transformed layer.
+ */
+static void setChunkedCell(QVector<Chunk> &chunks, int chunkColumns,
+                           int x, int y, const Cell &cell)
+{
+    const int index = (x >> CHUNK_BITS) + (y >> CHUNK_BITS) * chunkColumns;
+    chunks[index].setCell(x & CHUNK_MASK, y & CHUNK_MASK, cell);
+}
+
 /**
  * Recomputes the draw margins. Needed after the tile offset of a tileset
  * has changed for example.
@@ -67,25 +299,33 @@ static QMargins maxMargins(const QMargins &a,
  */
 void TileLayer::recomputeDrawMargins()
 {
+    ensureDecoded();
+
     QSize maxTileSize(0, 0);
     QMargins offsetMargins;
 
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Cell &cell = mGrid.at(i);
-        if (const Tile *tile = cell.tile) {
-            QSize size = tile->size();
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        const Chunk &chunk = mChunks.at(i);
+        if (!chunk.isAllocated())
+            continue;
 
-            if (cell.flippedAntiDiagonally)
-                size.transpose();
+        for (int j = 0; j < CHUNK_SIZE * CHUNK_SIZE; ++j) {
+            const Cell cell = chunk.cellAt(j);
+            if (const Tile *tile = cell.tile) {
+                QSize size = tile->size();
 
-            const QPoint offset = tile->offset();
+                if (cell.flippedAntiDiagonally)
+                    size.transpose();
 
-            maxTileSize = maxSize(size, maxTileSize);
-            offsetMargins = maxMargins(QMargins(-offset.x(),
-                                                 -offset.y(),
-                                                 offset.x(),
-                                                 offset.y()),
-                                        offsetMargins);
+                const QPoint offset = tile->offset();
+
+                maxTileSize = maxSize(size, maxTileSize);
+                offsetMargins = maxMargins(QMargins(-offset.x(),
+                                                     -offset.y(),
+                                                     offset.x(),
+                                                     offset.y()),
+                                            offsetMargins);
+            }
         }
     }
 
@@ -99,8 +339,120 @@ void TileLayer::recomputeDrawMargins()
 void TileLayer::setCell(int x, int y, const Cell &cell)
 {
     Q_ASSERT(contains(x, y));
+    aboutToChange();
 
     if (cell.tile) {
+        growDrawMargins(&cell, 1);
+
+        if (mMap)
+            mMap->adjustDrawMargins(drawMargins());
+    }
+
+    Chunk &chunk = mChunks[chunkIndex(x, y)];
+    updateTilesetUseCounts(chunk.cellAt(x & CHUNK_MASK, y & CHUNK_MASK), cell);
+    chunk.setCell(x & CHUNK_MASK, y & CHUNK_MASK, cell);
+}
+
+void TileLayer::getCells(int x, int y, int width, Cell *cells) const
+{
+    Q_ASSERT(x >= 0 && width >= 0 && x + width <= mWidth);
+    Q_ASSERT(width == 0 || (y >= 0 && y < mHeight));
+    ensureDecoded();
+
+    const int end = x + width;
+
+    while (x < end) {
+        const int chunkEnd = qMin(end, (x | CHUNK_MASK) + 1);
+        const Chunk &chunk = mChunks.at(chunkIndex(x, y));
+
+        if (!chunk.isAllocated()) {
+            std::fill(cells, cells + (chunkEnd - x), Cell());
+            cells += chunkEnd - x;
+            x = chunkEnd;
+            continue;
+        }
+
+        const PackedCell *packed = chunk.constData() +
+                (x & CHUNK_MASK) + (y & CHUNK_MASK) * CHUNK_SIZE;
+
+        for (; x < chunkEnd; ++x)
+            *cells++ = (packed++)->unpack();
+    }
+}
+
+void TileLayer::setCells(int x, int y, int width, const Cell *cells)
+{
+    Q_ASSERT(x >= 0 && width >= 0 && x + width <= mWidth);
+    Q_ASSERT(width == 0 || (y >= 0 && y < mHeight));
+    aboutToChange();
+
+    writeCells(x, y, width, cells, false);
+
+    if (mMap)
+        mMap->adjustDrawMargins(drawMargins());
+}
+
+void TileLayer::mergeCells(int x, int y, int width, const Cell *cells)
+{
+    Q_ASSERT(x >= 0 && width >= 0 && x + width <= mWidth);
+    Q_ASSERT(width == 0 || (y >= 0 && y < mHeight));
+    aboutToChange();
+
+    writeCells(x, y, width, cells, true);
+
+    if (mMap)
+        mMap->adjustDrawMargins(drawMargins());
+}
+
+void TileLayer::fill(const QRect &rect, const Cell &cell)
+{
+    const QRect area = rect & QRect(0, 0, mWidth, mHeight);
+    if (area.isEmpty())
+        return;
+
+    aboutToChange();
+
+    const QVector<Cell> row(area.width(), cell);
+
+    for (int y = area.top(); y <= area.bottom(); ++y)
+        writeCells(area.left(), y, area.width(), row.constData(), false);
+
+    if (cell.tile && mMap)
+        mMap->adjustDrawMargins(drawMargins());
+}
+
+void TileLayer::blit(int x, int y, const TileLayer *source,
+                     const QRect &sourceRect, bool skipEmpty)
+{
+    aboutToChange();
+    blitCells(x, y, source, sourceRect, skipEmpty);
+
+    if (mMap)
+        mMap->adjustDrawMargins(drawMargins());
+}
+
+/**
+ * Grows the draw margins to fit the given \a cells. Does not notify the map,
+ * so that callers can do this once after changing any number of cells.
+ */
+void TileLayer::growDrawMargins(const Cell *cells, int count)
+{
+    const Tile *lastTile = 0;
+    bool lastFlippedAntiDiagonally = false;
+
+    for (int i = 0; i < count; ++i) {
+        const Cell &cell = cells[i];
+        if (!cell.tile)
+            continue;
+
+        // Runs of the same tile are common, and only need to be looked at once
+        if (cell.tile == lastTile &&
+                cell.flippedAntiDiagonally == lastFlippedAntiDiagonally)
+            continue;
+
+        lastTile = cell.tile;
+        lastFlippedAntiDiagonally = cell.flippedAntiDiagonally;
+
         QSize size = cell.tile->size();
 
         if (cell.flippedAntiDiagonally)
@@ -114,50 +466,186 @@ void TileLayer::setCell(int x, int y, const Cell &cell)
                                              offset.x(),
                                              offset.y()),
                                     mOffsetMargins);
+    }
+}
 
-        if (mMap)
-            mMap->adjustDrawMargins(drawMargins());
+/**
+ * Writes the \a width cells of a row starting at (\a x, \a y), a chunk at a
+ * time. Grows the draw margins, but leaves notifying the map to the caller.
+ */
+void TileLayer::writeCells(int x, int y, int width, const Cell *cells,
+                           bool skipEmpty)
+{
+    growDrawMargins(cells, width);
+
+    const int end = x + width;
+
+    while (x < end) {
+        const int chunkEnd = qMin(end, (x | CHUNK_MASK) + 1);
+        Chunk &chunk = mChunks[chunkIndex(x, y)];
+        int index = (x & CHUNK_MASK) + (y & CHUNK_MASK) * CHUNK_SIZE;
+
+        for (; x < chunkEnd; ++x, ++index, ++cells) {
+            if (skipEmpty && cells->isEmpty())
+                continue;
+
+            updateTilesetUseCounts(chunk.cellAt(index), *cells);
+            chunk.setCell(index, *cells);
+        }
     }
+}
 
-    mGrid[x + y * mWidth] = cell;
+/**
+ * Implements blit(), but leaves notifying the map to the caller.
+ */
+void TileLayer::blitCells(int x, int y, const TileLayer *source,
+                          const QRect &sourceRect, bool skipEmpty)
+{
+    // Determine the overlapping area, in the coordinates of this layer
+    const QPoint offset = sourceRect.topLeft() - QPoint(x, y);
+    QRect area = sourceRect & QRect(0, 0, source->width(), source->height());
+    area.translate(-offset);
+    area &= QRect(0, 0, mWidth, mHeight);
+
+    if (area.isEmpty())
+        return;
+
+    QVector<Cell> row(area.width());
+
+    for (int _y = area.top(); _y <= area.bottom(); ++_y) {
+        source->getCells(area.left() + offset.x(), _y + offset.y(),
+                         area.width(), row.data());
+        writeCells(area.left(), _y, area.width(), row.constData(), skipEmpty);
+    }
+}
+
+/**
+ * Updates the tileset use counts for a cell changing from \a oldCell to
+ * \a newCell.
+ */
+void TileLayer::updateTilesetUseCounts(const Cell &oldCell,
+                                       const Cell &newCell)
+{
+    const Tileset *oldTileset = oldCell.tile ? oldCell.tile->tileset() : 0;
+    const Tileset *newTileset = newCell.tile ? newCell.tile->tileset() : 0;
+
+    if (oldTileset == newTileset)
+        return;
+
+    if (oldTileset) {
+        QHash<const Tileset*, int>::iterator it =
+                mTilesetUseCounts.find(oldTileset);
+        Q_ASSERT(it != mTilesetUseCounts.end());
+        if (--it.value() == 0)
+            mTilesetUseCounts.erase(it);
+    }
+
+    if (newTileset)
+        ++mTilesetUseCounts[newTileset];
+}
+
+/**
+ * Recounts the cells referring to each tileset. Used after the cells have
+ * been replaced in bulk.
+ */
+void TileLayer::recomputeTilesetUseCounts()
+{
+    mTilesetUseCounts.clear();
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        const Chunk &chunk = mChunks.at(i);
+        if (!chunk.isAllocated())
+            continue;
+
+        const PackedCell *cells = chunk.constData();
+        const Tileset *lastTileset = 0;
+        int *lastCount = 0;
+
+        for (int y = 0; y < CHUNK_SIZE; ++y, cells += CHUNK_SIZE) {
+            if (emptyCells(cells, CHUNK_SIZE))
+                continue;
+
+            for (int x = 0; x < CHUNK_SIZE; ++x) {
+                const Tile *tile = cells[x].tile();
+                if (!tile)
+                    continue;
+
+                if (tile->tileset() != lastTileset) {
+                    lastTileset = tile->tileset();
+                    lastCount = &mTilesetUseCounts[lastTileset];
+                }
+                ++*lastCount;
+            }
+        }
+    }
 }
 
 TileLayer *TileLayer::copy(const QRegion &region) const
 {
+    ensureDecoded();
+
     const QRegion area = region.intersected(QRect(0, 0, width(), height()));
     const QRect bounds = region.boundingRect();
     const QRect areaBounds = area.boundingRect();
-    const int offsetX = qMax(0, areaBounds.x() - bounds.x());
-    const int offsetY = qMax(0, areaBounds.y() - bounds.y());
 
     TileLayer *copied = new TileLayer(QString(),
                                       0, 0,
                                       bounds.width(), bounds.height());
 
-    foreach (const QRect &rect, area.rects())
-        for (int x = rect.left(); x <= rect.right(); ++x)
-            for (int y = rect.top(); y <= rect.bottom(); ++y)
-                copied->setCell(x - areaBounds.x() + offsetX,
-                                y - areaBounds.y() + offsetY,
-                                cellAt(x, y));
+    if (area.isEmpty())
+        return copied;
+
+    // The copy only contains tiles from this layer, so it can take over its
+    // draw margins instead of updating them for each cell.
+    copied->mMaxTileSize = mMaxTileSize;
+    copied->mOffsetMargins = mOffsetMargins;
+
+    // When the copied area starts at a chunk boundary, chunks that are fully
+    // contained in the area map onto a single chunk of the copy and can be
+    // shared with it instead of being copied cell by cell.
+    const bool aligned = ((bounds.x() | bounds.y()) & CHUNK_MASK) == 0;
+
+    const int firstChunkX = areaBounds.left() >> CHUNK_BITS;
+    const int firstChunkY = areaBounds.top() >> CHUNK_BITS;
+    const int lastChunkX = areaBounds.right() >> CHUNK_BITS;
+    const int lastChunkY = areaBounds.bottom() >> CHUNK_BITS;
+
+    for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY) {
+        for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX) {
+            const Chunk &chunk = mChunks.at(chunkX + chunkY * mChunkColumns);
+            if (!chunk.isAllocated())
+                continue;
+
+            const QRect rect = chunkRect(chunkX, chunkY);
+            const QRegion chunkArea = area.intersected(rect);
+
+            if (aligned && chunkArea.rectCount() == 1
+                    && chunkArea.boundingRect() == rect) {
+                const int index = copied->chunkIndex(rect.x() - bounds.x(),
+                                                     rect.y() - bounds.y());
+                copied->mChunks[index] = chunk;
+                continue;
+            }
+
+            foreach (const QRect &r, chunkArea.rects())
+                for (int y = r.top(); y <= r.bottom(); ++y)
+                    for (int x = r.left(); x <= r.right(); ++x)
+                        setChunkedCell(copied->mChunks, copied->mChunkColumns,
+                                       x - bounds.x(), y - bounds.y(),
+                                       chunk.cellAt(x & CHUNK_MASK,
+                                                    y & CHUNK_MASK));
+        }
+    }
+
+    copied->recomputeTilesetUseCounts();
 
     return copied;
 }
 
 void TileLayer::merge(const QPoint &pos, const TileLayer *layer)
 {
-    // Determine the overlapping area
-    QRect area = QRect(pos, QSize(layer->width(), layer->height()));
-    area &= QRect(0, 0, width(), height());
-
-    for (int y = area.top(); y <= area.bottom(); ++y) {
-        for (int x = area.left(); x <= area.right(); ++x) {
-            const Cell &cell = layer->cellAt(x - area.left(),
-                                             y - area.top());
-            if (!cell.isEmpty())
-                setCell(x, y, cell);
-        }
-    }
+    blit(pos.x(), pos.y(), layer, QRect(0, 0, layer->width(), layer->height()),
+         true);
 }
 
 void TileLayer::setCells(int x, int y, TileLayer *layer,
@@ -170,126 +658,229 @@ void TileLayer::setCells(int x, int y, TileLayer *layer,
     if (!mask.isEmpty())
         area &= mask;
 
+    aboutToChange();
+
     foreach (const QRect &rect, area.rects())
-        for (int _x = rect.left(); _x <= rect.right(); ++_x)
-            for (int _y = rect.top(); _y <= rect.bottom(); ++_y)
-                setCell(_x, _y, layer->cellAt(_x - x, _y - y));
+        blitCells(rect.x(), rect.y(), layer, rect.translated(-x, -y), false);
+
+    if (mMap)
+        mMap->adjustDrawMargins(drawMargins());
 }
 
 void TileLayer::erase(const QRegion &area)
 {
-    const Cell emptyCell;
     foreach (const QRect &rect, area.rects())
-        for (int x = rect.left(); x <= rect.right(); ++x)
-            for (int y = rect.top(); y <= rect.bottom(); ++y)
-                setCell(x, y, emptyCell);
+        fill(rect, Cell());
 }
 
-void TileLayer::flip(FlipDirection direction)
+/*
+ * Flipping and rotating first transform the layer as if its size was rounded
+ * up to whole chunks. This maps each chunk onto exactly one chunk, which can
+ * be transformed on its own through a block of scratch cells, updating the
+ * flip flags in the same pass. Since the rounded up part of the layer is
+ * empty, the layer is afterwards shifted back by less than a chunk to drop
+ * it again.
+ *
+ * This way the cells are only ever copied one chunk at a time, and the memory
+ * of each source chunk is released or reused before the next one is done.
+ */
+
+/**
+ * Flips the cells of \a chunk within the chunk, using \a block as scratch
+ * space.
+ */
+static void flipChunk(Chunk &chunk, FlipDirection direction, PackedCell *block)
 {
-    QVector<Cell> newGrid(mWidth * mHeight);
+    if (!chunk.isAllocated())
+        return;
 
-    Q_ASSERT(direction == FlipHorizontally || direction == FlipVertically);
+    const PackedCell *cells = chunk.constData();
 
-    for (int y = 0; y < mHeight; ++y) {
-        for (int x = 0; x < mWidth; ++x) {
-            Cell &dest = newGrid[x + y * mWidth];
-            if (direction == FlipHorizontally) {
-                const Cell &source = cellAt(mWidth - x - 1, y);
-                dest = source;
-                dest.flippedHorizontally = !source.flippedHorizontally;
-            } else if (direction == FlipVertically) {
-                const Cell &source = cellAt(x, mHeight - y - 1);
-                dest = source;
-                dest.flippedVertically = !source.flippedVertically;
-            }
+    for (int y = 0; y < CHUNK_SIZE; ++y) {
+        for (int x = 0; x < CHUNK_SIZE; ++x) {
+            const PackedCell cell = cells[x + y * CHUNK_SIZE].flipped(direction);
+            if (direction == FlipHorizontally)
+                block[(CHUNK_MASK - x) + y * CHUNK_SIZE] = cell;
+            else
+                block[x + (CHUNK_MASK - y) * CHUNK_SIZE] = cell;
         }
     }
 
-    mGrid = newGrid;
+    chunk.setCells(block);
 }
 
-void TileLayer::rotate(RotateDirection direction)
+void TileLayer::flip(FlipDirection direction)
 {
-    static const char rotateRightMask[8] = { 5, 4, 1, 0, 7, 6, 3, 2 };
-    static const char rotateLeftMask[8]  = { 3, 2, 7, 6, 1, 0, 5, 4 };
-
-    const char (&rotateMask)[8] =
-            (direction == RotateRight) ? rotateRightMask : rotateLeftMask;
-
-    int newWidth = mHeight;
-    int newHeight = mWidth;
-    QVector<Cell> newGrid(newWidth * newHeight);
-
-    for (int y = 0; y < mHeight; ++y) {
-        for (int x = 0; x < mWidth; ++x) {
-            const Cell &source = cellAt(x, y);
-            Cell dest = source;
+    Q_ASSERT(direction == FlipHorizontally || direction == FlipVertically);
+    aboutToChange();
+
+    const int chunkRows = chunkRowsForHeight(mHeight);
+    PackedCell block[CHUNK_SIZE * CHUNK_SIZE];
+
+    // Swap each chunk with its mirror and flip both. With an odd number of
+    // chunks, the middle ones are mirrored onto themselves.
+    const bool horizontal = direction == FlipHorizontally;
+    const int columns = horizontal ? (mChunkColumns + 1) / 2 : mChunkColumns;
+    const int rows = horizontal ? chunkRows : (chunkRows + 1) / 2;
+
+    for (int chunkY = 0; chunkY < rows; ++chunkY) {
+        for (int chunkX = 0; chunkX < columns; ++chunkX) {
+            const int index = chunkX + chunkY * mChunkColumns;
+            const int mirror = horizontal ?
+                        (mChunkColumns - chunkX - 1) + chunkY * mChunkColumns :
+                        chunkX + (chunkRows - chunkY - 1) * mChunkColumns;
+
+            if (mirror != index) {
+                std::swap(mChunks[index], mChunks[mirror]);
+                flipChunk(mChunks[mirror], direction, block);
+            }
+            flipChunk(mChunks[index], direction, block);
+        }
+    }
 
-            unsigned char mask =
-                    (dest.flippedHorizontally << 2) |
-                    (dest.flippedVertically << 1) |
-                    (dest.flippedAntiDiagonally << 0);
+    if (horizontal) {
+        const int shift = mChunkColumns * CHUNK_SIZE - mWidth;
+        if (shift > 0)
+            shiftChunksLeft(mChunks, mChunkColumns, shift);
+    } else {
+        const int shift = chunkRows * CHUNK_SIZE - mHeight;
+        if (shift > 0)
+            shiftChunksUp(mChunks, mChunkColumns, shift);
+    }
+}
 
-            mask = rotateMask[mask];
+void TileLayer::rotate(RotateDirection direction)
+{
+    aboutToChange();
+
+    const int chunkRows = chunkRowsForHeight(mHeight);
+    const int newChunkColumns = chunkRows;
+    QVector<Chunk> newChunks(mChunks.size());
+    PackedCell block[CHUNK_SIZE * CHUNK_SIZE];
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        if (!mChunks.at(i).isAllocated())
+            continue;
+
+        const int chunkX = i % mChunkColumns;
+        const int chunkY = i / mChunkColumns;
+        const PackedCell *cells = mChunks.at(i).constData();
+        int target;
+
+        if (direction == RotateRight) {
+            target = (chunkRows - chunkY - 1) + chunkX * newChunkColumns;
+
+            for (int y = 0; y < CHUNK_SIZE; ++y)
+                for (int x = 0; x < CHUNK_SIZE; ++x)
+                    block[(CHUNK_MASK - y) + x * CHUNK_SIZE] =
+                            cells[x + y * CHUNK_SIZE].rotated(direction);
+        } else {
+            target = chunkY + (mChunkColumns - chunkX - 1) * newChunkColumns;
+
+            for (int y = 0; y < CHUNK_SIZE; ++y)
+                for (int x = 0; x < CHUNK_SIZE; ++x)
+                    block[y + (CHUNK_MASK - x) * CHUNK_SIZE] =
+                            cells[x + y * CHUNK_SIZE].rotated(direction);
+        }
 
-            dest.flippedHorizontally = (mask & 4) != 0;
-            dest.flippedVertically = (mask & 2) != 0;
-            dest.flippedAntiDiagonally = (mask & 1) != 0;
+        newChunks[target].setCells(block);
+        mChunks[i] = Chunk();
+    }
 
-            if (direction == RotateRight)
-                newGrid[x * newWidth + (mHeight - y - 1)] = dest;
-            else
-                newGrid[(mWidth - x - 1) * newWidth + y] = dest;
-        }
+    if (direction == RotateRight) {
+        const int shift = chunkRows * CHUNK_SIZE - mHeight;
+        if (shift > 0)
+            shiftChunksLeft(newChunks, newChunkColumns, shift);
+    } else {
+        const int shift = mChunkColumns * CHUNK_SIZE - mWidth;
+        if (shift > 0)
+            shiftChunksUp(newChunks, newChunkColumns, shift);
     }
 
     std::swap(mMaxTileSize.rwidth(),
               mMaxTileSize.rheight());
 
-    mWidth = newWidth;
-    mHeight = newHeight;
-    mGrid = newGrid;
+    std::swap(mWidth, mHeight);
+    mChunkColumns = newChunkColumns;
+    mChunks = newChunks;
 }
 
 
 QSet<SharedTileset> TileLayer::usedTilesets() const
 {
+    ensureDecoded();
+
     QSet<SharedTileset> tilesets;
 
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
-        if (const Tile *tile = mGrid.at(i).tile)
-            tilesets.insert(tile->sharedTileset());
+    QHashIterator<const Tileset*, int> it(mTilesetUseCounts);
+    while (it.hasNext())
+        tilesets.insert(it.next().key()->sharedPointer());
 
     return tilesets;
 }
 
-bool TileLayer::referencesTileset(const Tileset *tileset) const
-{
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Tile *tile = mGrid.at(i).tile;
-        if (tile && tile->tileset() == tileset)
-            return true;
-    }
-    return false;
-}
-
 void TileLayer::removeReferencesToTileset(Tileset *tileset)
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Tile *tile = mGrid.at(i).tile;
-        if (tile && tile->tileset() == tileset)
-            mGrid.replace(i, Cell());
+    ensureDecoded();
+
+    if (!mTilesetUseCounts.remove(tileset))
+        return;
+
+    mEncodedData.clear();
+    mDecodeError.clear();
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        if (!mChunks.at(i).isAllocated())
+            continue;
+
+        Chunk &chunk = mChunks[i];
+        for (int j = 0; j < CHUNK_SIZE * CHUNK_SIZE; j += CHUNK_SIZE) {
+            if (!chunk.isAllocated())
+                break;
+            if (emptyCells(chunk.constData() + j, CHUNK_SIZE))
+                continue;
+
+            for (int k = j; k < j + CHUNK_SIZE; ++k) {
+                const Tile *tile = chunk.cellAt(k).tile;
+                if (tile && tile->tileset() == tileset)
+                    chunk.setCell(k, Cell());
+            }
+        }
     }
 }
 
 void TileLayer::replaceReferencesToTileset(Tileset *oldTileset,
                                            Tileset *newTileset)
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Tile *tile = mGrid.at(i).tile;
-        if (tile && tile->tileset() == oldTileset)
-            mGrid[i].tile = newTileset->tileAt(tile->id());
+    ensureDecoded();
+
+    if (!mTilesetUseCounts.contains(oldTileset))
+        return;
+
+    mEncodedData.clear();
+    mDecodeError.clear();
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        if (!mChunks.at(i).isAllocated())
+            continue;
+
+        Chunk &chunk = mChunks[i];
+        for (int j = 0; j < CHUNK_SIZE * CHUNK_SIZE; j += CHUNK_SIZE) {
+            if (!chunk.isAllocated())
+                break;
+            if (emptyCells(chunk.constData() + j, CHUNK_SIZE))
+                continue;
+
+            for (int k = j; k < j + CHUNK_SIZE; ++k) {
+                Cell cell = chunk.cellAt(k);
+                if (cell.tile && cell.tile->tileset() == oldTileset) {
+                    const Cell oldCell = cell;
+                    cell.tile = newTileset->tileAt(cell.tile->id());
+                    updateTilesetUseCounts(oldCell, cell);
+                    chunk.setCell(k, cell);
+                }
+            }
+        }
     }
 }
 
@@ -298,22 +889,56 @@ void TileLayer::resize(const QSize &size, const QPoint &offset)
     if (this->size() == size && offset.isNull())
         return;
 
-    QVector<Cell> newGrid(size.width() * size.height());
+    aboutToChange();
+
+    const int newChunkColumns = chunkColumnsForWidth(size.width());
+    QVector<Chunk> newChunks(newChunkColumns *
+                             chunkRowsForHeight(size.height()));
 
     // Copy over the preserved part
     const int startX = qMax(0, -offset.x());
     const int startY = qMax(0, -offset.y());
     const int endX = qMin(mWidth, size.width() - offset.x());
     const int endY = qMin(mHeight, size.height() - offset.y());
+    const QRect preserved(startX, startY, endX - startX, endY - startY);
+
+    // When shifting by whole chunks, chunks that are entirely preserved can
+    // be shared with the resized layer instead of being copied.
+    const bool aligned = ((offset.x() | offset.y()) & CHUNK_MASK) == 0;
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        const Chunk &chunk = mChunks.at(i);
+        if (!chunk.isAllocated())
+            continue;
+
+        const QRect fullRect = chunkRect(i % mChunkColumns, i / mChunkColumns);
+        const QRect rect = fullRect & preserved;
 
-    for (int y = startY; y < endY; ++y) {
-        for (int x = startX; x < endX; ++x) {
-            const int index = x + offset.x() + (y + offset.y()) * size.width();
-            newGrid[index] = cellAt(x, y);
+        if (aligned && rect == fullRect) {
+            const int index = ((rect.x() + offset.x()) >> CHUNK_BITS) +
+                    ((rect.y() + offset.y()) >> CHUNK_BITS) * newChunkColumns;
+            newChunks[index] = chunk;
+            continue;
+        }
+
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                const Cell cell = chunk.cellAt(x & CHUNK_MASK,
+                                               y & CHUNK_MASK);
+                if (!cell.isEmpty())
+                    setChunkedCell(newChunks, newChunkColumns,
+                                   x + offset.x(), y + offset.y(), cell);
+            }
         }
     }
 
-    mGrid = newGrid;
+    mChunkColumns = newChunkColumns;
+    mChunks = newChunks;
+
+    // Only when cells were cut off do the tileset use counts change
+    if (preserved != QRect(0, 0, mWidth, mHeight))
+        recomputeTilesetUseCounts();
+
     setSize(size);
 }
 
@@ -321,13 +946,15 @@ void TileLayer::offset(const QPoint &offset,
                        const QRect &bounds,
                        bool wrapX, bool wrapY)
 {
-    QVector<Cell> newGrid(mWidth * mHeight);
+    aboutToChange();
+
+    QVector<Chunk> newChunks(mChunks.size());
 
     for (int y = 0; y < mHeight; ++y) {
         for (int x = 0; x < mWidth; ++x) {
             // Skip out of bounds tiles
             if (!bounds.contains(x, y)) {
-                newGrid[x + y * mWidth] = cellAt(x, y);
+                setChunkedCell(newChunks, mChunkColumns, x, y, cellAt(x, y));
                 continue;
             }
 
@@ -353,13 +980,13 @@ void TileLayer::offset(const QPoint &offset,
 
             // Set the new tile
             if (contains(oldX, oldY) && bounds.contains(oldX, oldY))
-                newGrid[x + y * mWidth] = cellAt(oldX, oldY);
-            else
-                newGrid[x + y * mWidth] = Cell();
+                setChunkedCell(newChunks, mChunkColumns,
+                               x, y, cellAt(oldX, oldY));
         }
     }
 
-    mGrid = newGrid;
+    mChunks = newChunks;
+    recomputeTilesetUseCounts();
 }
 
 bool TileLayer::canMergeWith(Layer *other) const
@@ -383,13 +1010,50 @@ Layer *TileLayer::mergedWith(Layer *other) const
 
 QRegion TileLayer::computeDiffRegion(const TileLayer *other) const
 {
-    QRegion ret;
+    ensureDecoded();
+    other->ensureDecoded();
+
+    RegionBuilder builder;
 
     const int dx = other->x() - mX;
     const int dy = other->y() - mY;
     QRect r = QRect(0, 0, width(), height());
     r &= QRect(dx, dy, other->width(), other->height());
 
+    if (((dx | dy) & CHUNK_MASK) == 0) {
+        // The chunks of both layers line up, so their rows can be compared
+        // in bulk. Chunks shared between the layers are skipped entirely.
+        static const PackedCell emptyRow[CHUNK_SIZE];
+
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            for (int x = r.left(); x <= r.right(); ) {
+                const int end = qMin(r.right() + 1, (x | CHUNK_MASK) + 1);
+                const int count = end - x;
+
+                const Chunk &a = mChunks.at(chunkIndex(x, y));
+                const Chunk &b = other->mChunks.at(other->chunkIndex(x - dx,
+                                                                     y - dy));
+
+                if (a.isAllocated() || b.isAllocated()) {
+                    const int offset = (x & CHUNK_MASK) +
+                            (y & CHUNK_MASK) * CHUNK_SIZE;
+
+                    const PackedCell *cellsA = a.isAllocated() ?
+                                a.constData() + offset : emptyRow;
+                    const PackedCell *cellsB = b.isAllocated() ?
+                                b.constData() + offset : emptyRow;
+
+                    if (cellsA != cellsB && !equalCells(cellsA, cellsB, count))
+                        addDifferingSpans(builder, cellsA, cellsB, count, x, y);
+                }
+
+                x = end;
+            }
+        }
+
+        return builder.region();
+    }
+
     for (int y = r.top(); y <= r.bottom(); ++y) {
         for (int x = r.left(); x <= r.right(); ++x) {
             if (cellAt(x, y) != other->cellAt(x - dx, y - dy)) {
@@ -399,23 +1063,77 @@ QRegion TileLayer::computeDiffRegion(const TileLayer *other) const
                     ++x;
                 }
                 const int rangeEnd = x;
-                ret += QRect(rangeStart, y, rangeEnd - rangeStart, 1);
+                builder.addSpan(rangeStart, y, rangeEnd - rangeStart);
             }
         }
     }
 
-    return ret;
+    return builder.region();
 }
 
 bool TileLayer::isEmpty() const
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
-        if (!mGrid.at(i).isEmpty())
+    ensureDecoded();
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i)
+        if (mChunks.at(i).isAllocated())
             return false;
 
     return true;
 }
 
+QVector<QRect> TileLayer::nonEmptyChunkRects() const
+{
+    ensureDecoded();
+
+    QVector<QRect> rects;
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i)
+        if (!mChunks.at(i).isEmpty())
+            rects.append(chunkRect(i % mChunkColumns, i / mChunkColumns));
+
+    return rects;
+}
+
+void TileLayer::setEncodedData(const SharedEncodedLayerData &data)
+{
+    Q_ASSERT(isEmpty());
+
+    mEncodedData = data;
+    mDecoded = !data;
+}
+
+QString TileLayer::decode()
+{
+    if (mDecoded)
+        return mDecodeError;
+
+    // Setting the cells while decoding clears the encoded data, since it
+    // assumes the layer is being changed
+    const SharedEncodedLayerData data = mEncodedData;
+    mDecoded = true;
+
+    mDecodeError = data->decode(this);
+    mEncodedData = data;
+
+    return mDecodeError;
+}
+
+bool TileLayer::discardDecodedData()
+{
+    if (!mDecoded || !mEncodedData)
+        return false;
+
+    mChunks = QVector<Chunk>(mChunks.size());
+    mTilesetUseCounts.clear();
+    mMaxTileSize = QSize(0, 0);
+    mOffsetMargins = QMargins();
+    mDecodeError.clear();
+    mDecoded = false;
+
+    return true;
+}
+
 /**
  * Returns a duplicate of this TileLayer.
  *
@@ -429,8 +1147,13 @@ Layer *TileLayer::clone() const
 TileLayer *TileLayer::initializeClone(TileLayer *clone) const
 {
     Layer::initializeClone(clone);
-    clone->mGrid = mGrid;
+    clone->mChunkColumns = mChunkColumns;
+    clone->mChunks = mChunks;
+    clone->mTilesetUseCounts = mTilesetUseCounts;
     clone->mMaxTileSize = mMaxTileSize;
     clone->mOffsetMargins = mOffsetMargins;
+    clone->mEncodedData = mEncodedData;
+    clone->mDecodeError = mDecodeError;
+    clone->mDecoded = mDecoded;
     return clone;
 }
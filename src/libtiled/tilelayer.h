@@ -33,9 +33,12 @@
 #include "tiled_global.h"
 
 #include "layer.h"
+#include "regionbuilder.h"
 #include "tiled.h"
 
+#include <QHash>
 #include <QMargins>
+#include <QRegion>
 #include <QString>
 #include <QVector>
 #include <QSharedPointer>
@@ -88,10 +91,214 @@ public:
     bool flippedAntiDiagonally;
 };
 
+/**
+ * The compact representation of a Cell, used for storing cells in a tile
+ * layer. The flip flags are stored in the lowest bits of the tile pointer,
+ * which are always zero since tiles are heap allocated with at least 8-byte
+ * alignment. This makes a packed cell the size of a single pointer.
+ *
+ * Empty cells are always stored as zero, regardless of their flags.
+ */
+class PackedCell
+{
+public:
+    PackedCell() : mValue(0) {}
+
+    explicit PackedCell(const Cell &cell) : mValue(0)
+    {
+        if (!cell.tile)
+            return;
+
+        mValue = reinterpret_cast<quintptr>(cell.tile);
+        Q_ASSERT((mValue & FlagMask) == 0);
+
+        if (cell.flippedHorizontally)
+            mValue |= FlippedHorizontally;
+        if (cell.flippedVertically)
+            mValue |= FlippedVertically;
+        if (cell.flippedAntiDiagonally)
+            mValue |= FlippedAntiDiagonally;
+    }
+
+    bool isEmpty() const { return mValue == 0; }
+
+    Tile *tile() const
+    { return reinterpret_cast<Tile*>(mValue & ~quintptr(FlagMask)); }
+
+    Cell unpack() const
+    {
+        Cell cell(tile());
+        cell.flippedHorizontally = (mValue & FlippedHorizontally) != 0;
+        cell.flippedVertically = (mValue & FlippedVertically) != 0;
+        cell.flippedAntiDiagonally = (mValue & FlippedAntiDiagonally) != 0;
+        return cell;
+    }
+
+    /**
+     * Returns this cell flipped in the given \a direction, which must be
+     * horizontal or vertical.
+     */
+    PackedCell flipped(FlipDirection direction) const
+    {
+        PackedCell cell;
+        if (!isEmpty())
+            cell.mValue = mValue ^ (direction == FlipHorizontally ?
+                                        FlippedHorizontally :
+                                        FlippedVertically);
+        return cell;
+    }
+
+    /**
+     * Returns this cell rotated by 90 degrees in the given \a direction.
+     */
+    PackedCell rotated(RotateDirection direction) const
+    {
+        static const unsigned char rotateRightFlags[8] = { 5, 7, 4, 6, 1, 3, 0, 2 };
+        static const unsigned char rotateLeftFlags[8]  = { 6, 4, 7, 5, 2, 0, 3, 1 };
+
+        const unsigned char (&rotateFlags)[8] =
+                (direction == RotateRight) ? rotateRightFlags : rotateLeftFlags;
+
+        PackedCell cell;
+        if (!isEmpty())
+            cell.mValue = (mValue & ~quintptr(FlagMask)) |
+                    rotateFlags[mValue & FlagMask];
+        return cell;
+    }
+
+    bool operator == (const PackedCell &other) const
+    { return mValue == other.mValue; }
+
+    bool operator != (const PackedCell &other) const
+    { return mValue != other.mValue; }
+
+private:
+    enum Flags {
+        FlippedHorizontally     = 0x1,
+        FlippedVertically       = 0x2,
+        FlippedAntiDiagonally   = 0x4,
+        FlagMask                = 0x7
+    };
+
+    quintptr mValue;
+};
+
+/**
+ * The width and height of the chunks a tile layer is divided into. Chunks are
+ * only allocated when a cell in them is set, so that large sparse layers do
+ * not waste memory on empty cells.
+ */
+const int CHUNK_BITS = 4;
+const int CHUNK_SIZE = 1 << CHUNK_BITS;
+const int CHUNK_MASK = CHUNK_SIZE - 1;
+
+/**
+ * A square block of CHUNK_SIZE by CHUNK_SIZE cells.
+ *
+ * The cells are only allocated once a non-empty cell is set, and they are
+ * released again when the last non-empty cell is removed.
+ */
+class TILEDSHARED_EXPORT Chunk
+{
+public:
+    Chunk() : mCellCount(0) {}
+
+    /**
+     * Returns whether this chunk has allocated its cells. An unallocated
+     * chunk contains only empty cells.
+     */
+    bool isAllocated() const { return !mGrid.isEmpty(); }
+
+    /**
+     * Returns whether all cells in this chunk are empty.
+     */
+    bool isEmpty() const { return mCellCount == 0; }
+
+    /**
+     * Returns the number of non-empty cells in this chunk.
+     */
+    int cellCount() const { return mCellCount; }
+
+    Cell cellAt(int x, int y) const;
+    Cell cellAt(int index) const;
+
+    void setCell(int x, int y, const Cell &cell);
+    void setCell(int index, const Cell &cell);
+
+    /**
+     * Returns the packed cells of this chunk in row-major order. Only valid
+     * for allocated chunks. Chunks sharing their cells return the same
+     * pointer.
+     */
+    const PackedCell *constData() const { return mGrid.constData(); }
+
+    void setCells(const PackedCell *cells);
+
+private:
+    QVector<PackedCell> mGrid;
+    int mCellCount;
+};
+
+inline Cell Chunk::cellAt(int x, int y) const
+{
+    return cellAt(x + y * CHUNK_SIZE);
+}
+
+inline Cell Chunk::cellAt(int index) const
+{
+    Q_ASSERT(index >= 0 && index < CHUNK_SIZE * CHUNK_SIZE);
+    return isAllocated() ? mGrid.at(index).unpack() : Cell();
+}
+
+inline void Chunk::setCell(int x, int y, const Cell &cell)
+{
+    setCell(x + y * CHUNK_SIZE, cell);
+}
+
+class TileLayer;
+
+/**
+ * The encoded cells of a tile layer, which a reader can attach to the layer
+ * instead of decoding them right away.
+ *
+ * \sa TileLayer::setEncodedData()
+ */
+class TILEDSHARED_EXPORT EncodedLayerData
+{
+public:
+    virtual ~EncodedLayerData() {}
+
+    /**
+     * Decodes the data into the cells of the given \a tileLayer, which are
+     * all empty when this is called. Returns an error message, or an empty
+     * string when successful.
+     */
+    virtual QString decode(TileLayer *tileLayer) const = 0;
+};
+
+typedef QSharedPointer<const EncodedLayerData> SharedEncodedLayerData;
+
 /**
  * A tile layer is a grid of cells. Each cell refers to a specific tile, and
  * stores how the tile is flipped.
  *
+ * The cells are stored in chunks of CHUNK_SIZE by CHUNK_SIZE, which are
+ * allocated on first write. Empty areas of the layer take no memory and are
+ * skipped by functions like isEmpty() and region().
+ *
+ * The layer keeps count of the cells referring to each tileset, so that
+ * usedTilesets() and referencesTileset() don't need to look at the cells.
+ *
+ * Chunks are implicitly shared, so clone() only needs to reference the
+ * chunks of the original layer. A chunk is detached when either layer writes
+ * to it, making copies proportional to the number of chunks touched.
+ *
+ * A layer can also be given encoded data, which is only decoded once the
+ * cells are first accessed. As long as the layer is not changed, its cells
+ * can be discarded again to save memory. Since decoding also changes the
+ * draw margins of the map, a layer needs to be decoded before its cells are
+ * accessed from another thread.
+ *
  * Coordinates and regions passed to function parameters are in local
  * coordinates and do not take into account the position of the layer.
  */
@@ -106,7 +313,7 @@ public:
     /**
      * Returns the maximum tile size of this layer.
      */
-    QSize maxTileSize() const { return mMaxTileSize; }
+    QSize maxTileSize() const { ensureDecoded(); return mMaxTileSize; }
 
     /**
      * Returns the margins that have to be taken into account while drawing
@@ -115,6 +322,7 @@ public:
      */
     QMargins drawMargins() const
     {
+        ensureDecoded();
         return QMargins(mOffsetMargins.left(),
                         mOffsetMargins.top() + mMaxTileSize.height(),
                         mOffsetMargins.right() + mMaxTileSize.width(),
@@ -146,21 +354,62 @@ public:
     QRegion region() const;
 
     /**
-     * Returns a read-only reference to the cell at the given coordinates. The
-     * coordinates have to be within this layer.
+     * Returns the cell at the given coordinates. The coordinates have to be
+     * within this layer.
      */
-    const Cell &cellAt(int x, int y) const;
+    Cell cellAt(int x, int y) const;
 
-    const Cell &cellAt(const QPoint &point) const;
+    Cell cellAt(const QPoint &point) const;
 
     /**
      * Sets the cell at the given coordinates.
      */
     void setCell(int x, int y, const Cell &cell);
 
+    /**
+     * Reads the \a width cells of the row starting at (\a x, \a y) into
+     * \a cells. The row has to be within this layer.
+     */
+    void getCells(int x, int y, int width, Cell *cells) const;
+
+    /**
+     * Sets the \a width cells of the row starting at (\a x, \a y) to the
+     * given \a cells. The row has to be within this layer.
+     *
+     * Unlike calling setCell() for each cell, the draw margins are only
+     * updated once.
+     */
+    void setCells(int x, int y, int width, const Cell *cells);
+
+    /**
+     * Like setCells(int, int, int, const Cell *), but empty cells in \a cells
+     * leave the cells of this layer unchanged.
+     */
+    void mergeCells(int x, int y, int width, const Cell *cells);
+
+    /**
+     * Sets all cells within \a rect to \a cell. Parts of the rectangle that
+     * fall outside of this layer are ignored.
+     */
+    void fill(const QRect &rect, const Cell &cell);
+
+    /**
+     * Copies the cells in \a sourceRect of the \a source layer to this layer,
+     * with the top-left of the rectangle ending up at (\a x, \a y). Parts
+     * that fall outside of either layer are ignored.
+     *
+     * When \a skipEmpty is true, empty cells in the source layer leave the
+     * cells of this layer unchanged.
+     */
+    void blit(int x, int y, const TileLayer *source, const QRect &sourceRect,
+              bool skipEmpty = false);
+
     /**
      * Returns a copy of the area specified by the given \a region. The
      * caller is responsible for the returned tile layer.
+     *
+     * When the region starts at a chunk boundary, fully covered chunks are
+     * shared with the copy and only duplicated once either layer changes them.
      */
     TileLayer *copy(const QRegion &region) const;
 
@@ -204,10 +453,17 @@ public:
     void rotate(RotateDirection direction);
 
     /**
-     * Computes and returns the set of tilesets used by this tile layer.
+     * Returns the set of tilesets used by this tile layer.
      */
     QSet<SharedTileset> usedTilesets() const override;
 
+    /**
+     * Returns the number of cells on this layer that refer to a tile from the
+     * given \a tileset.
+     */
+    int tilesetUseCount(const Tileset *tileset) const
+    { ensureDecoded(); return mTilesetUseCounts.value(tileset); }
+
     /**
      * Returns whether this tile layer has any cell for which the given
      * \a condition returns true.
@@ -218,7 +474,8 @@ public:
     /**
      * Returns whether this tile layer is referencing the given tileset.
      */
-    bool referencesTileset(const Tileset *tileset) const;
+    bool referencesTileset(const Tileset *tileset) const
+    { ensureDecoded(); return mTilesetUseCounts.contains(tileset); }
 
     /**
      * Removes all references to the given tileset. This sets all tiles on this
@@ -262,48 +519,178 @@ public:
      */
     bool isEmpty() const;
 
+    /**
+     * Returns the rectangles of the chunks that contain any tiles, in row
+     * major order. Chunks at the right and bottom edges are clipped to the
+     * layer.
+     */
+    QVector<QRect> nonEmptyChunkRects() const;
+
+    /**
+     * Makes this layer decode its cells from the given \a data once they
+     * are first needed. The layer should be empty.
+     */
+    void setEncodedData(const SharedEncodedLayerData &data);
+
+    /**
+     * Returns whether the cells of this layer are available, rather than
+     * waiting to be decoded from its encoded data.
+     */
+    bool isDecoded() const { return mDecoded; }
+
+    /**
+     * Decodes the cells of this layer, when that didn't happen yet. Returns
+     * an error message when decoding failed.
+     *
+     * When the cells are decoded because they are accessed, errors are
+     * ignored and cells that could not be decoded are left empty. The error
+     * is still returned by later calls, until the layer is changed.
+     */
+    QString decode();
+
+    /**
+     * Releases the cells of this layer, if they can be decoded again from
+     * its encoded data. This is possible until the layer is changed.
+     * Returns whether the cells were released.
+     */
+    bool discardDecodedData();
+
     virtual Layer *clone() const;
 
 protected:
     TileLayer *initializeClone(TileLayer *clone) const;
 
 private:
+    static int chunkColumnsForWidth(int width)
+    { return (width + CHUNK_MASK) >> CHUNK_BITS; }
+
+    static int chunkRowsForHeight(int height)
+    { return (height + CHUNK_MASK) >> CHUNK_BITS; }
+
+    void growDrawMargins(const Cell *cells, int count);
+    void writeCells(int x, int y, int width, const Cell *cells,
+                    bool skipEmpty);
+    void blitCells(int x, int y, const TileLayer *source,
+                   const QRect &sourceRect, bool skipEmpty);
+
+    void updateTilesetUseCounts(const Cell &oldCell, const Cell &newCell);
+    void recomputeTilesetUseCounts();
+
+    void ensureDecoded() const
+    {
+        if (Q_UNLIKELY(!mDecoded))
+            const_cast<TileLayer*>(this)->decode();
+    }
+
+    /**
+     * Called before the cells are changed, after which they no longer match
+     * the encoded data.
+     */
+    void aboutToChange()
+    {
+        ensureDecoded();
+        mEncodedData.clear();
+        mDecodeError.clear();
+    }
+
+    int chunkIndex(int x, int y) const
+    { return (x >> CHUNK_BITS) + (y >> CHUNK_BITS) * mChunkColumns; }
+
+    /**
+     * Returns the part of the chunk at (\a chunkX, \a chunkY) that lies
+     * within the bounds of this layer, in local cell coordinates.
+     */
+    QRect chunkRect(int chunkX, int chunkY) const
+    {
+        const int x = chunkX << CHUNK_BITS;
+        const int y = chunkY << CHUNK_BITS;
+        return QRect(x, y,
+                     qMin(CHUNK_SIZE, mWidth - x),
+                     qMin(CHUNK_SIZE, mHeight - y));
+    }
+
     QSize mMaxTileSize;
     QMargins mOffsetMargins;
-    QVector<Cell> mGrid;
+    int mChunkColumns;
+    QVector<Chunk> mChunks;
+    QHash<const Tileset*, int> mTilesetUseCounts;
+    SharedEncodedLayerData mEncodedData;
+    QString mDecodeError;
+    bool mDecoded;
 };
 
 
 template<typename Condition>
 QRegion TileLayer::region(Condition condition) const
 {
-    QRegion region;
+    ensureDecoded();
+
+    RegionBuilder builder;
+
+    // Unallocated chunks only contain empty cells, so they either match
+    // entirely or not at all.
+    const bool emptyMatches = condition(Cell());
 
     for (int y = 0; y < mHeight; ++y) {
-        for (int x = 0; x < mWidth; ++x) {
-            if (condition(cellAt(x, y))) {
-                const int rangeStart = x;
-                for (++x; x <= mWidth; ++x) {
-                    if (x == mWidth || !condition(cellAt(x, y))) {
-                        const int rangeEnd = x;
-                        region += QRect(rangeStart + mX, y + mY,
-                                        rangeEnd - rangeStart, 1);
-                        break;
-                    }
+        int rangeStart = -1;
+
+        for (int x = 0; x < mWidth; ) {
+            const Chunk &chunk = mChunks.at(chunkIndex(x, y));
+            const int chunkEnd = qMin(mWidth, (x | CHUNK_MASK) + 1);
+
+            if (!chunk.isAllocated()) {
+                if (emptyMatches) {
+                    if (rangeStart == -1)
+                        rangeStart = x;
+                } else if (rangeStart != -1) {
+                    builder.addSpan(rangeStart + mX, y + mY, x - rangeStart);
+                    rangeStart = -1;
+                }
+                x = chunkEnd;
+                continue;
+            }
+
+            const int localY = y & CHUNK_MASK;
+            for (; x < chunkEnd; ++x) {
+                if (condition(chunk.cellAt(x & CHUNK_MASK, localY))) {
+                    if (rangeStart == -1)
+                        rangeStart = x;
+                } else if (rangeStart != -1) {
+                    builder.addSpan(rangeStart + mX, y + mY, x - rangeStart);
+                    rangeStart = -1;
                 }
             }
         }
+
+        if (rangeStart != -1)
+            builder.addSpan(rangeStart + mX, y + mY, mWidth - rangeStart);
     }
 
-    return region;
+    return builder.region();
 }
 
 template<typename Condition>
 bool TileLayer::hasCell(Condition condition) const
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
-        if (condition(mGrid.at(i)))
-            return true;
+    ensureDecoded();
+
+    const bool emptyMatches = condition(Cell());
+
+    for (int i = 0, i_end = mChunks.size(); i < i_end; ++i) {
+        const Chunk &chunk = mChunks.at(i);
+
+        if (!chunk.isAllocated()) {
+            if (emptyMatches)
+                return true;
+            continue;
+        }
+
+        const QRect rect = chunkRect(i % mChunkColumns, i / mChunkColumns);
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+            for (int x = rect.left(); x <= rect.right(); ++x)
+                if (condition(chunk.cellAt(x & CHUNK_MASK, y & CHUNK_MASK)))
+                    return true;
+    }
 
     return false;
 }
@@ -316,13 +703,14 @@ inline QRegion TileLayer::region() const
     return region(cellInUse);
 }
 
-inline const Cell &TileLayer::cellAt(int x, int y) const
+inline Cell TileLayer::cellAt(int x, int y) const
 {
     Q_ASSERT(contains(x, y));
-    return mGrid.at(x + y * mWidth);
+    ensureDecoded();
+    return mChunks.at(chunkIndex(x, y)).cellAt(x & CHUNK_MASK, y & CHUNK_MASK);
 }
 
-inline const Cell &TileLayer::cellAt(const QPoint &point) const
+inline Cell TileLayer::cellAt(const QPoint &point) const
 {
     return cellAt(point.x(), point.y());
 }
@@ -331,4 +719,6 @@ typedef QSharedPointer<TileLayer> SharedTileLayer;
 
 } // namespace Tiled
 
+Q_DECLARE_TYPEINFO(Tiled::PackedCell, Q_PRIMITIVE_TYPE);
+
 #endif // TILELAYER_H
@@ -30,8 +30,7 @@
 #include "tileset.h"
 #include "tile.h"
 #include "terrain.h"
-
-#include <QBitmap>
+#include "transparentcolor.h"
 
 using namespace Tiled;
 
@@ -78,21 +77,22 @@ bool Tileset::loadFromImage(const QImage &image,
     int oldTilesetSize = tileCount();
     int tileNum = 0;
 
+    // All tiles share a single pixmap of the whole image, each referring to
+    // their part of it
+    const QPixmap atlas = QPixmap::fromImage(
+                mTransparentColor.isValid() ?
+                    applyTransparentColor(image, mTransparentColor) : image);
+
     for (int y = margin; y <= stopHeight; y += tileSize.height() + spacing) {
         for (int x = margin; x <= stopWidth; x += tileSize.width() + spacing) {
-            const QImage tileImage = image.copy(x, y, tileSize.width(), tileSize.height());
-            QPixmap tilePixmap = QPixmap::fromImage(tileImage);
-
-            if (mTransparentColor.isValid()) {
-                const QImage mask =
-                        tileImage.createMaskFromColor(mTransparentColor.rgb());
-                tilePixmap.setMask(QBitmap::fromImage(mask));
-            }
+            const QRect imageRect(QPoint(x, y), tileSize);
 
             if (tileNum < oldTilesetSize) {
-                mTiles.at(tileNum)->setImage(tilePixmap);
+                mTiles.at(tileNum)->setImage(atlas, imageRect);
             } else {
-                mTiles.append(new Tile(tilePixmap, tileNum, this));
+                Tile *tile = new Tile(atlas, tileNum, this);
+                tile->setImage(atlas, imageRect);
+                mTiles.append(tile);
             }
             ++tileNum;
         }
@@ -350,7 +350,7 @@ void Tileset::setTileImage(int id, const QPixmap &image,
     if (!tile)
         return;
 
-    const QSize previousImageSize = tile->image().size();
+    const QSize previousImageSize = tile->size();
     const QSize newImageSize = image.size();
 
     tile->setImage(image);
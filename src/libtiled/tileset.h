@@ -30,6 +30,7 @@
 #ifndef TILESET_H
 #define TILESET_H
 
+#include "imagecache.h"
 #include "object.h"
 
 #include <QColor>
@@ -330,11 +331,11 @@ private:
 
 
 /**
- * Convenience override that loads the image using the QImage constructor.
+ * Convenience override that loads the image through the ImageCache.
  */
 inline bool Tileset::loadFromImage(const QString &fileName)
 {
-    return loadFromImage(QImage(fileName), fileName);
+    return loadFromImage(ImageCache::loadImage(fileName), fileName);
 }
 
 inline SharedTileset Tileset::sharedPointer() const
@@ -0,0 +1,154 @@
+/*
+ * tilesetcache.cpp
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tilesetcache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+using namespace Tiled;
+
+namespace {
+
+/**
+ * Identifies the version of a file, to detect when it changed.
+ */
+struct FileStamp
+{
+    FileStamp() : size(-1) {}
+
+    explicit FileStamp(const QFileInfo &fileInfo)
+        : lastModified(fileInfo.lastModified())
+        , size(fileInfo.exists() ? fileInfo.size() : -1)
+    {}
+
+    bool operator==(const FileStamp &other) const
+    { return lastModified == other.lastModified && size == other.size; }
+
+    QDateTime lastModified;
+    qint64 size;
+};
+
+struct CachedTileset
+{
+    SharedTileset tileset;
+    FileStamp fileStamp;
+    FileStamp imageStamp;
+};
+
+QMutex cacheMutex;
+QHash<QString, CachedTileset> cache;
+bool cacheEnabled = false;
+
+FileStamp imageStamp(const Tileset *tileset)
+{
+    if (tileset->imageSource().isEmpty())
+        return FileStamp();
+    return FileStamp(QFileInfo(tileset->imageSource()));
+}
+
+} // anonymous namespace
+
+/**
+ * Returns whether MapReader consults this cache. It is disabled by default.
+ */
+bool TilesetCache::isEnabled()
+{
+    QMutexLocker locker(&cacheMutex);
+    return cacheEnabled;
+}
+
+/**
+ * Sets whether MapReader consults this cache. Disabling the cache also
+ * clears it.
+ */
+void TilesetCache::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&cacheMutex);
+    cacheEnabled = enabled;
+    if (!enabled)
+        cache.clear();
+}
+
+/**
+ * Returns the cached tileset loaded from \a fileName, or a null pointer when
+ * it is not cached or when the tileset file or its image changed since.
+ */
+SharedTileset TilesetCache::find(const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName);
+    const QString canonicalPath = fileInfo.canonicalFilePath();
+    if (canonicalPath.isEmpty())
+        return SharedTileset();
+
+    QMutexLocker locker(&cacheMutex);
+
+    auto it = cache.find(canonicalPath);
+    if (it == cache.end())
+        return SharedTileset();
+
+    if (it->fileStamp == FileStamp(fileInfo) &&
+            it->imageStamp == imageStamp(it->tileset.data()))
+        return it->tileset;
+
+    cache.erase(it);
+    return SharedTileset();
+}
+
+/**
+ * Caches the \a tileset that was loaded from \a fileName. Does nothing when
+ * the cache is not enabled.
+ */
+void TilesetCache::insert(const QString &fileName, const SharedTileset &tileset)
+{
+    const QFileInfo fileInfo(fileName);
+    const QString canonicalPath = fileInfo.canonicalFilePath();
+    if (canonicalPath.isEmpty())
+        return;
+
+    CachedTileset cached;
+    cached.tileset = tileset;
+    cached.fileStamp = FileStamp(fileInfo);
+    cached.imageStamp = imageStamp(tileset.data());
+
+    QMutexLocker locker(&cacheMutex);
+    if (cacheEnabled)
+        cache.insert(canonicalPath, cached);
+}
+
+/**
+ * Drops all tilesets from the cache.
+ */
+void TilesetCache::clear()
+{
+    QMutexLocker locker(&cacheMutex);
+    cache.clear();
+}
@@ -0,0 +1,63 @@
+/*
+ * tilesetcache.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILED_TILESETCACHE_H
+#define TILED_TILESETCACHE_H
+
+#include "tileset.h"
+
+namespace Tiled {
+
+/**
+ * A process-wide cache of external tilesets, which MapReader consults when
+ * enabled so that maps referring to the same tileset file share the loaded
+ * tileset instead of each parsing the file and decoding its image again.
+ *
+ * Since the tilesets are shared between maps, this should only be enabled
+ * by applications that do not modify the tilesets of the maps they load.
+ * The editor uses its TilesetManager for this instead.
+ *
+ * A cached tileset is dropped when its file or its image file changed.
+ *
+ * All functions are thread-safe.
+ */
+class TILEDSHARED_EXPORT TilesetCache
+{
+public:
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    static SharedTileset find(const QString &fileName);
+    static void insert(const QString &fileName, const SharedTileset &tileset);
+
+    static void clear();
+};
+
+} // namespace Tiled
+
+#endif // TILED_TILESETCACHE_H
@@ -0,0 +1,141 @@
+/*
+ * transparentcolor.cpp
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "transparentcolor.h"
+
+#include <QPair>
+#include <QVector>
+#include <QtConcurrentMap>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace Tiled;
+
+namespace {
+
+/**
+ * Sets the \a count pixels in \a pixels that are equal to \a key to zero,
+ * which is fully transparent in premultiplied ARGB.
+ */
+void clearColorKey(quint32 *pixels, int count, quint32 key)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i vkey = _mm256_set1_epi32(int(key));
+    for (; i + 8 <= count; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i*>(pixels + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        _mm256_storeu_si256(p, _mm256_andnot_si256(_mm256_cmpeq_epi32(v, vkey), v));
+    }
+#elif defined(__SSE2__)
+    const __m128i vkey = _mm_set1_epi32(int(key));
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i*>(pixels + i);
+        const __m128i v = _mm_loadu_si128(p);
+        _mm_storeu_si128(p, _mm_andnot_si128(_mm_cmpeq_epi32(v, vkey), v));
+    }
+#endif
+
+    for (; i < count; ++i)
+        if (pixels[i] == key)
+            pixels[i] = 0;
+}
+
+/**
+ * Converts a band of rows of an image to premultiplied ARGB and clears the
+ * color key from it, writing the result to the same rows of another image.
+ */
+class ConvertBand
+{
+public:
+    typedef void result_type;
+
+    ConvertBand(const QImage &source, QImage &target, quint32 key)
+        : mSource(source)
+        , mBits(target.bits())
+        , mBytesPerLine(target.bytesPerLine())
+        , mKey(key)
+    {}
+
+    void operator()(const QPair<int, int> &rows) const
+    {
+        const int width = mSource.width();
+        const QImage band = mSource.copy(0, rows.first,
+                                         width, rows.second - rows.first)
+                .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+        for (int y = rows.first; y < rows.second; ++y) {
+            quint32 *line = reinterpret_cast<quint32*>(mBits + y * mBytesPerLine);
+            memcpy(line, band.constScanLine(y - rows.first), width * 4);
+            clearColorKey(line, width, mKey);
+        }
+    }
+
+private:
+    const QImage &mSource;
+    uchar *mBits;
+    int mBytesPerLine;
+    quint32 mKey;
+};
+
+} // anonymous namespace
+
+QImage Tiled::applyTransparentColor(const QImage &image, const QColor &color)
+{
+    if (image.isNull())
+        return image;
+
+    const quint32 key = color.rgb();
+    const int width = image.width();
+    const int height = image.height();
+
+    // Opaque pixels are the same in premultiplied format, and it is the
+    // format pixmaps use on most platforms
+    QImage result(width, height, QImage::Format_ARGB32_Premultiplied);
+
+    // Small images are not worth the overhead of the thread pool
+    const int bandHeight = qMax(1, (256 * 256) / width);
+
+    QVector<QPair<int, int> > bands;
+    for (int y = 0; y < height; y += bandHeight)
+        bands.append(qMakePair(y, qMin(y + bandHeight, height)));
+
+    const ConvertBand convertBand(image, result, key);
+
+    if (bands.size() == 1)
+        convertBand(bands.first());
+    else
+        QtConcurrent::blockingMap(bands, convertBand);
+
+    return result;
+}
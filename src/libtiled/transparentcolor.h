@@ -0,0 +1,54 @@
+/*
+ * transparentcolor.h
+ * Copyright 2015, Thorbjørn Lindeijer <bjorn@lindeijer.nl>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRANSPARENTCOLOR_H
+#define TRANSPARENTCOLOR_H
+
+#include "tiled_global.h"
+
+#include <QColor>
+#include <QImage>
+
+namespace Tiled {
+
+/**
+ * Returns \a image converted to a format with an alpha channel, with all
+ * pixels of the given \a color made fully transparent.
+ *
+ * This replaces masking a pixmap with QPixmap::setMask, which is slow to
+ * create and to draw with. The pixels are compared a vector register at a
+ * time and large images are converted and keyed in bands of rows on the
+ * global thread pool.
+ * Since no QPixmap is involved, this can be called from any thread.
+ */
+TILEDSHARED_EXPORT QImage applyTransparentColor(const QImage &image,
+                                                const QColor &color);
+
+} // namespace Tiled
+
+#endif // TRANSPARENTCOLOR_H
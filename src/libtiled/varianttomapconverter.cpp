@@ -21,6 +21,8 @@
 
 #include "varianttomapconverter.h"
 
+#include "compression.h"
+#include "imagecache.h"
 #include "imagelayer.h"
 #include "map.h"
 #include "mapobject.h"
@@ -79,6 +81,11 @@ Map *VariantToMapConverter::toMap(const QVariant &variant,
     map->setStaggerAxis(staggerAxis);
     map->setStaggerIndex(staggerIndex);
     map->setRenderOrder(renderOrder);
+
+    bool compressionLevelOk;
+    const int compressionLevel = variantMap[QLatin1String("compressionlevel")].toInt(&compressionLevelOk);
+    if (compressionLevelOk)
+        map->setCompressionLevel(compressionLevel);
     if (nextObjectId)
         map->setNextObjectId(nextObjectId);
 
@@ -270,12 +277,7 @@ TileLayer *VariantToMapConverter::toTileLayer(const QVariantMap &variantMap)
     const QString name = variantMap[QLatin1String("name")].toString();
     const int width = variantMap[QLatin1String("width")].toInt();
     const int height = variantMap[QLatin1String("height")].toInt();
-    const QVariantList dataVariantList = variantMap[QLatin1String("data")].toList();
-
-    if (dataVariantList.size() != width * height) {
-        mError = tr("Corrupt layer data for layer '%1'").arg(name);
-        return 0;
-    }
+    const QString encoding = variantMap[QLatin1String("encoding")].toString();
 
     typedef QScopedPointer<TileLayer> TileLayerPtr;
     TileLayerPtr tileLayer(new TileLayer(name,
@@ -289,30 +291,157 @@ TileLayer *VariantToMapConverter::toTileLayer(const QVariantMap &variantMap)
     tileLayer->setOpacity(opacity);
     tileLayer->setVisible(visible);
 
+    const QString compression = variantMap[QLatin1String("compression")].toString();
+    const QRect layerRect(0, 0, width, height);
+
+    // Sparse layers only store the chunks that contain tiles
+    const QVariant chunksVariant = variantMap[QLatin1String("chunks")];
+
+    if (chunksVariant.isValid()) {
+        foreach (const QVariant &chunkVariant, chunksVariant.toList()) {
+            const QVariantMap chunkMap = chunkVariant.toMap();
+            const QRect chunk(chunkMap[QLatin1String("x")].toInt(),
+                              chunkMap[QLatin1String("y")].toInt(),
+                              chunkMap[QLatin1String("width")].toInt(),
+                              chunkMap[QLatin1String("height")].toInt());
+
+            if (chunk.isEmpty() || !layerRect.contains(chunk)) {
+                mError = tr("Invalid chunk in layer '%1'").arg(name);
+                return 0;
+            }
+
+            if (!readLayerData(tileLayer.data(), chunk,
+                               chunkMap[QLatin1String("data")],
+                               encoding, compression))
+                return 0;
+        }
+    } else {
+        if (!readLayerData(tileLayer.data(), layerRect,
+                           variantMap[QLatin1String("data")],
+                           encoding, compression))
+            return 0;
+    }
+
+    return tileLayer.take();
+}
+
+/**
+ * Reads the layer data in \a dataVariant into the given \a area of the
+ * tile layer, which is either the whole layer or one of its chunks.
+ */
+bool VariantToMapConverter::readLayerData(TileLayer *tileLayer,
+                                          const QRect &area,
+                                          const QVariant &dataVariant,
+                                          const QString &encoding,
+                                          const QString &compression)
+{
+    if (encoding.isEmpty() || encoding == QLatin1String("csv")) {
+        mMap->setLayerDataFormat(Map::CSV);
+        return readTileLayerData(tileLayer, area, dataVariant.toList());
+    } else if (encoding == QLatin1String("base64")) {
+        return readBase64TileLayerData(tileLayer, area, dataVariant.toString(),
+                                       compression);
+    }
+
+    mError = tr("Unknown encoding: %1").arg(encoding);
+    return false;
+}
+
+bool VariantToMapConverter::readTileLayerData(TileLayer *tileLayer,
+                                              const QRect &area,
+                                              const QVariantList &dataVariantList)
+{
+    const int width = area.width();
+
+    if (dataVariantList.size() != width * area.height()) {
+        mError = tr("Corrupt layer data for layer '%1'").arg(tileLayer->name());
+        return false;
+    }
+
     int x = 0;
     int y = 0;
     bool ok;
+    QVector<Cell> row(width);
 
     foreach (const QVariant &gidVariant, dataVariantList) {
         const unsigned gid = gidVariant.toUInt(&ok);
         if (!ok) {
             mError = tr("Unable to parse tile at (%1,%2) on layer '%3'")
-                    .arg(x).arg(y).arg(tileLayer->name());
-            return 0;
+                    .arg(area.x() + x).arg(area.y() + y).arg(tileLayer->name());
+            return false;
         }
 
-        const Cell cell = mGidMapper.gidToCell(gid, ok);
-
-        tileLayer->setCell(x, y, cell);
+        row[x] = mGidMapper.gidToCell(gid, ok);
 
         x++;
-        if (x >= tileLayer->width()) {
+        if (x >= width) {
+            tileLayer->setCells(area.x(), area.y() + y, x, row.constData());
             x = 0;
             y++;
         }
     }
 
-    return tileLayer.take();
+    return true;
+}
+
+bool VariantToMapConverter::readBase64TileLayerData(TileLayer *tileLayer,
+                                                    const QRect &area,
+                                                    const QString &data,
+                                                    const QString &compression)
+{
+    Map::LayerDataFormat format;
+    CompressionMethod method = Zlib;
+
+    if (compression.isEmpty()) {
+        format = Map::Base64;
+    } else if (compression == QLatin1String("gzip")) {
+        format = Map::Base64Gzip;
+    } else if (compression == QLatin1String("zlib")) {
+        format = Map::Base64Zlib;
+    } else if (compression == QLatin1String("zstd") && compressionSupported(Zstd)) {
+        format = Map::Base64Zstd;
+        method = Zstd;
+    } else if (compression == QLatin1String("lz4") && compressionSupported(Lz4)) {
+        format = Map::Base64Lz4;
+        method = Lz4;
+    } else {
+        mError = tr("Compression method '%1' not supported").arg(compression);
+        return false;
+    }
+
+    mMap->setLayerDataFormat(format);
+
+    const int width = area.width();
+    const int size = width * area.height() * 4;
+
+    QByteArray tileData = QByteArray::fromBase64(data.toLatin1());
+    if (format != Map::Base64)
+        tileData = decompress(tileData, size, method);
+
+    if (tileData.size() != size) {
+        mError = tr("Corrupt layer data for layer '%1'").arg(tileLayer->name());
+        return false;
+    }
+
+    const unsigned char *bytes =
+            reinterpret_cast<const unsigned char*>(tileData.constData());
+    QVector<Cell> row(width);
+    bool ok;
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = 0; x < width; ++x, bytes += 4) {
+            const unsigned gid = bytes[0] |
+                                 bytes[1] << 8 |
+                                 bytes[2] << 16 |
+                                 bytes[3] << 24;
+
+            row[x] = mGidMapper.gidToCell(gid, ok);
+        }
+
+        tileLayer->setCells(area.x(), y, width, row.constData());
+    }
+
+    return true;
 }
 
 ObjectGroup *VariantToMapConverter::toObjectGroup(const QVariantMap &variantMap)
@@ -421,7 +550,7 @@ ImageLayer *VariantToMapConverter::toImageLayer(const QVariantMap &variantMap)
 
     if (!imageVariant.isNull()) {
         QString imagePath = resolvePath(mMapDir, imageVariant);
-        if (!imageLayer->loadFromImage(QImage(imagePath), imagePath)) {
+        if (!imageLayer->loadFromImage(ImageCache::loadImage(imagePath), imagePath)) {
             mError = tr("Error loading image:\n'%1'").arg(imagePath);
             return 0;
         }
@@ -67,6 +67,18 @@ private:
     SharedTileset toTileset(const QVariant &variant);
     Layer *toLayer(const QVariant &variant);
     TileLayer *toTileLayer(const QVariantMap &variantMap);
+    bool readLayerData(TileLayer *tileLayer,
+                       const QRect &area,
+                       const QVariant &dataVariant,
+                       const QString &encoding,
+                       const QString &compression);
+    bool readTileLayerData(TileLayer *tileLayer,
+                           const QRect &area,
+                           const QVariantList &dataVariantList);
+    bool readBase64TileLayerData(TileLayer *tileLayer,
+                                 const QRect &area,
+                                 const QString &data,
+                                 const QString &compression);
     ObjectGroup *toObjectGroup(const QVariantMap &variantMap);
     ImageLayer *toImageLayer(const QVariantMap &variantMap);
 
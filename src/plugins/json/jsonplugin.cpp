@@ -87,6 +87,11 @@ bool JsonPlugin::write(const Tiled::Map *map, const QString &fileName)
     Tiled::MapToVariantConverter converter;
     QVariant variant = converter.toVariant(map, QFileInfo(fileName).dir());
 
+    if (!variant.isValid()) {
+        mError = converter.errorString();
+        return false;
+    }
+
     JsonWriter writer;
     writer.setAutoFormatting(true);
 
@@ -6,6 +6,7 @@ SUBDIRS = csv \
           lua \
           replicaisland \
           tengine \
+          tmb \
           tmw
 
 include(python/find_python.pri)
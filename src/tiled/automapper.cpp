@@ -476,6 +476,8 @@ void AutoMapper::autoMap(QRegion *where)
         }
     }
 
+    resolveInputLayers();
+
     // Increase the given region where the next automapper should work.
     // This needs to be done, so you can rely on the order of the rules at all
     // locations
@@ -503,6 +505,30 @@ const QRegion AutoMapper::getSetLayersRegion()
     return result;
 }
 
+void AutoMapper::resolveInputLayers()
+{
+    mResolvedInputRules.clear();
+
+    InputLayers::const_iterator it = mInputRules.constBegin();
+    for (; it != mInputRules.constEnd(); ++it) {
+        const InputIndex &ii = it.value();
+        QVector<ResolvedInputLayer> inputLayers;
+
+        InputIndex::const_iterator nameIt = ii.constBegin();
+        for (; nameIt != ii.constEnd(); ++nameIt) {
+            const int i = mMapWork->indexOfLayer(nameIt.key(),
+                                                 Layer::TileLayerType);
+
+            ResolvedInputLayer inputLayer;
+            inputLayer.setLayer = i == -1 ? 0 : mMapWork->layerAt(i)->asTileLayer();
+            inputLayer.conditions = &nameIt.value();
+            inputLayers.append(inputLayer);
+        }
+
+        mResolvedInputRules.append(inputLayers);
+    }
+}
+
 static bool compareLayerTo(const TileLayer *setLayer,
                            const QVector<TileLayer*> &listYes,
                            const QVector<TileLayer*> &listNo,
@@ -540,19 +566,19 @@ QRect AutoMapper::applyRule(const int ruleIndex, const QRect &where)
     for (int y = minY; y <= maxY; ++y)
     for (int x = minX; x <= maxX; ++x) {
         bool anymatch = false;
-        foreach (const QString &index, mInputRules.indexes) {
-            const InputIndex &ii = mInputRules[index];
+        for (int index = 0; index < mResolvedInputRules.size(); ++index) {
+            const QVector<ResolvedInputLayer> &inputLayers =
+                    mResolvedInputRules.at(index);
 
             bool allLayerNamesMatch = true;
-            foreach (const QString &name, ii.names) {
-                const int i = mMapWork->indexOfLayer(name, Layer::TileLayerType);
-                if (i == -1) {
+            for (int n = 0; n < inputLayers.size(); ++n) {
+                const ResolvedInputLayer &inputLayer = inputLayers.at(n);
+                if (!inputLayer.setLayer) {
                     allLayerNamesMatch = false;
                 } else {
-                    const TileLayer *setLayer = mMapWork->layerAt(i)->asTileLayer();
-                    allLayerNamesMatch &= compareLayerTo(setLayer,
-                                                         ii[name].listYes,
-                                                         ii[name].listNo,
+                    allLayerNamesMatch &= compareLayerTo(inputLayer.setLayer,
+                                                         inputLayer.conditions->listYes,
+                                                         inputLayer.conditions->listNo,
                                                          ruleInput,
                                                          QPoint(x, y));
                 }
@@ -830,15 +856,11 @@ void AutoMapper::copyTileRegion(TileLayer *srcLayer, int srcX, int srcY,
     const int offsetX = srcX - dstX;
     const int offsetY = srcY - dstY;
 
-    for (int x = startX; x < endX; ++x) {
-        for (int y = startY; y < endY; ++y) {
-            const Cell &cell = srcLayer->cellAt(x + offsetX, y + offsetY);
-            if (!cell.isEmpty()) {
-                // this is without graphics update, it's done afterwards for all
-                dstLayer->setCell(x, y, cell);
-            }
-        }
-    }
+    // this is without graphics update, it's done afterwards for all
+    dstLayer->blit(startX, startY, srcLayer,
+                   QRect(startX + offsetX, startY + offsetY,
+                         endX - startX, endY - startY),
+                   true);
 }
 
 void AutoMapper::copyObjectRegion(ObjectGroup *srcLayer, int srcX, int srcY,
@@ -935,4 +957,5 @@ void AutoMapper::cleanUpRuleMapLayers()
     mLayerInputRegions = 0;
     mLayerOutputRegions = 0;
     mInputRules.clear();
+    mResolvedInputRules.clear();
 }
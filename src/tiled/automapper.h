@@ -62,6 +62,17 @@ public:
     QSet<QString> names; // all names
 };
 
+/**
+ * An input layer name of an input index, resolved to the set layer with that
+ * name in the working map.
+ */
+class ResolvedInputLayer
+{
+public:
+    const TileLayer *setLayer;          // null when there is no such layer
+    const InputIndexName *conditions;
+};
+
 class RuleOutput : public QMap<Layer*, int>
 {
 public:
@@ -188,6 +199,13 @@ private:
      */
     const QRegion getSetLayersRegion();
 
+    /**
+     * Resolves the input layer names of all input indexes to the layers of
+     * mMapWork, so that applyRule doesn't need to look them up by name for
+     * each position.
+     */
+    void resolveInputLayers();
+
     /**
      * This copies all Tiles from TileLayer src to TileLayer dst
      *
@@ -299,6 +317,12 @@ private:
      */
     InputLayers mInputRules;
 
+    /**
+     * The input layers of each input index in mInputRules, resolved to the
+     * layers of mMapWork. Set up by resolveInputLayers for each autoMap run.
+     */
+    QVector<QVector<ResolvedInputLayer> > mResolvedInputRules;
+
     /**
      * List of Regions in mMapRules to know where the input rules are
      */
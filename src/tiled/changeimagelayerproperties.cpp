@@ -22,6 +22,7 @@
 
 #include "changeimagelayerproperties.h"
 
+#include "imagecache.h"
 #include "mapdocument.h"
 #include "imagelayer.h"
 
@@ -54,7 +55,7 @@ void ChangeImageLayerProperties::redo()
     if (mRedoPath.isEmpty())
         mImageLayer->resetImage();
     else
-        mImageLayer->loadFromImage(QImage(mRedoPath), mRedoPath);
+        mImageLayer->loadFromImage(ImageCache::loadImage(mRedoPath), mRedoPath);
 
     mMapDocument->emitImageLayerChanged(mImageLayer);
 }
@@ -66,7 +67,7 @@ void ChangeImageLayerProperties::undo()
     if (mUndoPath.isEmpty())
         mImageLayer->resetImage();
     else
-        mImageLayer->loadFromImage(QImage(mUndoPath), mUndoPath);
+        mImageLayer->loadFromImage(ImageCache::loadImage(mUndoPath), mUndoPath);
 
     mMapDocument->emitImageLayerChanged(mImageLayer);
 }
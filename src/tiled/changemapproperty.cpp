@@ -49,6 +49,10 @@ ChangeMapProperty::ChangeMapProperty(MapDocument *mapDocument,
         setText(QCoreApplication::translate("Undo Commands",
                                             "Change Hex Side Length"));
         break;
+    case CompressionLevel:
+        setText(QCoreApplication::translate("Undo Commands",
+                                            "Change Compression Level"));
+        break;
     default:
         break;
     }
@@ -184,6 +188,12 @@ void ChangeMapProperty::swap()
         mLayerDataFormat = layerDataFormat;
         break;
     }
+    case CompressionLevel: {
+        const int compressionLevel = map->compressionLevel();
+        map->setCompressionLevel(mIntValue);
+        mIntValue = compressionLevel;
+        break;
+    }
     }
 
     mMapDocument->emitMapChanged();
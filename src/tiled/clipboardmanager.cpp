@@ -35,6 +35,7 @@
 
 #include <QApplication>
 #include <QClipboard>
+#include <QDebug>
 #include <QMimeData>
 #include <QSet>
 #include <QUndoStack>
@@ -82,9 +83,14 @@ Map *ClipboardManager::map() const
 void ClipboardManager::setMap(const Map *map)
 {
     TmxMapWriter mapWriter;
+    const QByteArray data = mapWriter.toByteArray(map);
+    if (data.isEmpty()) {
+        qWarning() << "Failed to copy map:" << mapWriter.errorString();
+        return;
+    }
 
     QMimeData *mimeData = new QMimeData;
-    mimeData->setData(QLatin1String(TMX_MIMETYPE), mapWriter.toByteArray(map));
+    mimeData->setData(QLatin1String(TMX_MIMETYPE), data);
 
     mClipboard->setMimeData(mimeData);
 }
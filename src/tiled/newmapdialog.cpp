@@ -21,6 +21,7 @@
 #include "newmapdialog.h"
 #include "ui_newmapdialog.h"
 
+#include "compression.h"
 #include "isometricrenderer.h"
 #include "hexagonalrenderer.h"
 #include "map.h"
@@ -59,11 +60,15 @@ NewMapDialog::NewMapDialog(QWidget *parent) :
     const int tileHeight = s->value(QLatin1String(TILE_HEIGHT_KEY),
                                     32).toInt();
 
-    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "XML"));
-    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (uncompressed)"));
-    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (gzip compressed)"));
-    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (zlib compressed)"));
-    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "CSV"));
+    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "XML"), Map::XML);
+    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (uncompressed)"), Map::Base64);
+    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (gzip compressed)"), Map::Base64Gzip);
+    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (zlib compressed)"), Map::Base64Zlib);
+    mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "CSV"), Map::CSV);
+    if (compressionSupported(Zstd))
+        mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (Zstandard compressed)"), Map::Base64Zstd);
+    if (compressionSupported(Lz4))
+        mUi->layerFormat->addItem(QCoreApplication::translate("PreferencesDialog", "Base64 (LZ4 compressed)"), Map::Base64Lz4);
 
     mUi->renderOrder->addItem(QCoreApplication::translate("PreferencesDialog", "Right Down"));
     mUi->renderOrder->addItem(QCoreApplication::translate("PreferencesDialog", "Right Up"));
@@ -76,7 +81,7 @@ NewMapDialog::NewMapDialog(QWidget *parent) :
     mUi->orientation->addItem(tr("Hexagonal (Staggered)"), Map::Hexagonal);
 
     mUi->orientation->setCurrentIndex(orientation);
-    mUi->layerFormat->setCurrentIndex(prefs->layerDataFormat());
+    mUi->layerFormat->setCurrentIndex(qMax(0, mUi->layerFormat->findData(prefs->layerDataFormat())));
     mUi->renderOrder->setCurrentIndex(prefs->mapRenderOrder());
     mUi->mapWidth->setValue(mapWidth);
     mUi->mapHeight->setValue(mapHeight);
@@ -116,8 +121,10 @@ MapDocument *NewMapDialog::createMap()
     const QVariant orientationData = mUi->orientation->itemData(orientationIndex);
     const Map::Orientation orientation =
             static_cast<Map::Orientation>(orientationData.toInt());
+    const int layerFormatIndex = mUi->layerFormat->currentIndex();
+    const QVariant layerFormatData = mUi->layerFormat->itemData(layerFormatIndex);
     const Map::LayerDataFormat layerFormat =
-            static_cast<Map::LayerDataFormat>(mUi->layerFormat->currentIndex());
+            static_cast<Map::LayerDataFormat>(layerFormatData.toInt());
     const Map::RenderOrder renderOrder =
             static_cast<Map::RenderOrder>(mUi->renderOrder->currentIndex());
 
@@ -659,7 +659,7 @@ static QRectF objectBounds(const MapObject *object,
     if (!object->cell().isEmpty()) {
         // Tile objects can have a tile offset, which is scaled along with the image
         const Tile *tile = object->cell().tile;
-        const QSize imgSize = tile->image().size();
+        const QSize imgSize = tile->size();
         const QPointF position = renderer->pixelToScreenCoords(object->position());
 
         const QPoint tileOffset = tile->tileset()->tileOffset();
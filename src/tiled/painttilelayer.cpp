@@ -101,11 +101,9 @@ bool PaintTileLayer::mergeWith(const QUndoCommand *other)
 
     // Copy the newly erased tiles from the other command over
     foreach (const QRect &rect, newRegion.rects())
-        for (int y = rect.top(); y <= rect.bottom(); ++y)
-            for (int x = rect.left(); x <= rect.right(); ++x)
-                mErased->setCell(x - mX,
-                                 y - mY,
-                                 o->mErased->cellAt(x - o->mX, y - o->mY));
+        mErased->blit(rect.x() - mX, rect.y() - mY,
+                      o->mErased,
+                      rect.translated(-o->mX, -o->mY));
 
     return true;
 }
@@ -60,6 +60,7 @@ Preferences::Preferences()
             mSettings->value(QLatin1String("MapRenderOrder"),
                              Map::RightDown).toInt();
     mDtdEnabled = boolValue("DtdEnabled");
+    mChunkedLayerData = boolValue("ChunkedLayerData");
     mReloadTilesetsOnChange = boolValue("ReloadTilesets", true);
     mSettings->endGroup();
 
@@ -274,6 +275,17 @@ void Preferences::setDtdEnabled(bool enabled)
     mSettings->setValue(QLatin1String("Storage/DtdEnabled"), enabled);
 }
 
+bool Preferences::chunkedLayerData() const
+{
+    return mChunkedLayerData;
+}
+
+void Preferences::setChunkedLayerData(bool enabled)
+{
+    mChunkedLayerData = enabled;
+    mSettings->setValue(QLatin1String("Storage/ChunkedLayerData"), enabled);
+}
+
 QString Preferences::language() const
 {
     return mLanguage;
@@ -66,6 +66,9 @@ public:
     bool dtdEnabled() const;
     void setDtdEnabled(bool enabled);
 
+    bool chunkedLayerData() const;
+    void setChunkedLayerData(bool enabled);
+
     QString language() const;
     void setLanguage(const QString &language);
 
@@ -168,6 +171,7 @@ private:
     Map::LayerDataFormat mLayerDataFormat;
     Map::RenderOrder mMapRenderOrder;
     bool mDtdEnabled;
+    bool mChunkedLayerData;
     QString mLanguage;
     bool mReloadTilesetsOnChange;
     bool mUseOpenGL;
@@ -28,6 +28,7 @@
 #include "changeobjectgroupproperties.h"
 #include "changeproperties.h"
 #include "changetileprobability.h"
+#include "compression.h"
 #include "flipmapobjects.h"
 #include "imagelayer.h"
 #include "map.h"
@@ -86,6 +87,17 @@ PropertyBrowser::PropertyBrowser(QWidget *parent)
     mLayerFormatNames.append(QCoreApplication::translate("PreferencesDialog", "Base64 (gzip compressed)"));
     mLayerFormatNames.append(QCoreApplication::translate("PreferencesDialog", "Base64 (zlib compressed)"));
     mLayerFormatNames.append(QCoreApplication::translate("PreferencesDialog", "CSV"));
+    mLayerFormatValues << Map::XML << Map::Base64 << Map::Base64Gzip
+                       << Map::Base64Zlib << Map::CSV;
+
+    if (compressionSupported(Zstd)) {
+        mLayerFormatNames.append(QCoreApplication::translate("PreferencesDialog", "Base64 (Zstandard compressed)"));
+        mLayerFormatValues.append(Map::Base64Zstd);
+    }
+    if (compressionSupported(Lz4)) {
+        mLayerFormatNames.append(QCoreApplication::translate("PreferencesDialog", "Base64 (LZ4 compressed)"));
+        mLayerFormatValues.append(Map::Base64Lz4);
+    }
 
     mRenderOrderNames.append(QCoreApplication::translate("PreferencesDialog", "Right Down"));
     mRenderOrderNames.append(QCoreApplication::translate("PreferencesDialog", "Right Up"));
@@ -388,6 +400,13 @@ void PropertyBrowser::addMapProperties()
 
     layerFormatProperty->setAttribute(QLatin1String("enumNames"), mLayerFormatNames);
 
+    QtVariantProperty *compressionLevelProperty =
+            createProperty(CompressionLevelProperty, QVariant::Int,
+                           tr("Compression Level"), groupProperty);
+
+    compressionLevelProperty->setAttribute(QLatin1String("minimum"), -1);
+    compressionLevelProperty->setAttribute(QLatin1String("maximum"), 22);
+
     QtVariantProperty *renderOrderProperty =
             createProperty(RenderOrderProperty,
                            QtVariantPropertyManager::enumTypeId(),
@@ -575,10 +594,16 @@ void PropertyBrowser::applyMapValue(PropertyId id, const QVariant &val)
         break;
     }
     case LayerFormatProperty: {
-        Map::LayerDataFormat format = static_cast<Map::LayerDataFormat>(val.toInt());
+        Map::LayerDataFormat format =
+                static_cast<Map::LayerDataFormat>(mLayerFormatValues.at(val.toInt()));
         command = new ChangeMapProperty(mMapDocument, format);
         break;
     }
+    case CompressionLevelProperty: {
+        command = new ChangeMapProperty(mMapDocument, ChangeMapProperty::CompressionLevel,
+                                        val.toInt());
+        break;
+    }
     case RenderOrderProperty: {
         Map::RenderOrder renderOrder = static_cast<Map::RenderOrder>(val.toInt());
         command = new ChangeMapProperty(mMapDocument, renderOrder);
@@ -901,7 +926,8 @@ void PropertyBrowser::updateProperties()
         mIdToProperty[HexSideLengthProperty]->setValue(map->hexSideLength());
         mIdToProperty[StaggerAxisProperty]->setValue(map->staggerAxis());
         mIdToProperty[StaggerIndexProperty]->setValue(map->staggerIndex());
-        mIdToProperty[LayerFormatProperty]->setValue(map->layerDataFormat());
+        mIdToProperty[LayerFormatProperty]->setValue(mLayerFormatValues.indexOf(map->layerDataFormat()));
+        mIdToProperty[CompressionLevelProperty]->setValue(map->compressionLevel());
         mIdToProperty[RenderOrderProperty]->setValue(map->renderOrder());
         QColor backgroundColor = map->backgroundColor();
         if (!backgroundColor.isValid())
@@ -119,6 +119,7 @@ private:
         StaggerIndexProperty,
         RenderOrderProperty,
         LayerFormatProperty,
+        CompressionLevelProperty,
         ImageSourceProperty,
         FlippingProperty,
         DrawOrderProperty,
@@ -184,6 +185,7 @@ private:
     Properties mCombinedProperties;
 
     QStringList mLayerFormatNames;
+    QList<int> mLayerFormatValues;
     QStringList mRenderOrderNames;
     QStringList mFlippingFlagNames;
     QStringList mDrawOrderNames;
@@ -122,17 +122,11 @@ void TilePainter::drawCells(int x, int y, TileLayer *tileLayer)
     DrawMarginsWatcher watcher(mMapDocument, mTileLayer);
 
     foreach (const QRect &rect, region.rects()) {
-        for (int _y = rect.top(); _y <= rect.bottom(); ++_y) {
-            for (int _x = rect.left(); _x <= rect.right(); ++_x) {
-                const Cell &cell = tileLayer->cellAt(_x - x, _y - y);
-                if (cell.isEmpty())
-                    continue;
-
-                mTileLayer->setCell(_x - mTileLayer->x(),
-                                    _y - mTileLayer->y(),
-                                    cell);
-            }
-        }
+        mTileLayer->blit(rect.x() - mTileLayer->x(),
+                         rect.y() - mTileLayer->y(),
+                         tileLayer,
+                         rect.translated(-x, -y),
+                         true);
     }
 
     mMapDocument->emitRegionChanged(region);
@@ -155,19 +149,24 @@ void TilePainter::drawStamp(const TileLayer *stamp,
     const int h = stamp->height();
     const QRect regionBounds = region.boundingRect();
 
+    QVector<Cell> stampRow(w);
+    QVector<Cell> row(regionBounds.width());
+
     foreach (const QRect &rect, region.rects()) {
         for (int _y = rect.top(); _y <= rect.bottom(); ++_y) {
+            const int stampY = (_y - regionBounds.top()) % h;
+            stamp->getCells(0, stampY, w, stampRow.data());
+
+            // Repeat the stamp row over the width of the rect
             for (int _x = rect.left(); _x <= rect.right(); ++_x) {
                 const int stampX = (_x - regionBounds.left()) % w;
-                const int stampY = (_y - regionBounds.top()) % h;
-                const Cell &cell = stamp->cellAt(stampX, stampY);
-                if (cell.isEmpty())
-                    continue;
-
-                mTileLayer->setCell(_x - mTileLayer->x(),
-                                    _y - mTileLayer->y(),
-                                    cell);
+                row[_x - rect.left()] = stampRow.at(stampX);
             }
+
+            mTileLayer->mergeCells(rect.left() - mTileLayer->x(),
+                                   _y - mTileLayer->y(),
+                                   rect.width(),
+                                   row.constData());
         }
     }
 
@@ -644,14 +644,16 @@ void TilesetDock::removeTileset()
 void TilesetDock::removeTileset(int index)
 {
     Tileset *tileset = mTilesets.at(index).data();
-    const bool inUse = mMapDocument->map()->isTilesetUsed(tileset);
+    const int useCount = mMapDocument->map()->tilesetUseCount(tileset);
+    const bool inUse = useCount > 0;
 
     // If the tileset is in use, warn the user and confirm removal
     if (inUse) {
         QMessageBox warning(QMessageBox::Warning,
                             tr("Remove Tileset"),
-                            tr("The tileset \"%1\" is still in use by the "
-                               "map!").arg(tileset->name()),
+                            tr("The tileset \"%1\" is still used by %n "
+                               "tile(s) on the map!", 0,
+                               useCount).arg(tileset->name()),
                             QMessageBox::Yes | QMessageBox::No,
                             this);
         warning.setDefaultButton(QMessageBox::Yes);
@@ -68,10 +68,9 @@ int TilesetModel::columnCount(const QModelIndex &parent) const
 
 QVariant TilesetModel::data(const QModelIndex &index, int role) const
 {
-    if (role == Qt::DecorationRole) {
-        if (Tile *tile = tileAt(index))
-            return tile->image();
-    } else if (role == TerrainRole) {
+    // There is no decoration, since the TileDelegate draws the tiles directly
+    // from their atlas pixmap
+    if (role == TerrainRole) {
         if (Tile *tile = tileAt(index))
             return tile->terrain();
     }
@@ -35,6 +35,7 @@ bool TmxMapWriter::write(const Map *map, const QString &fileName)
 
     MapWriter writer;
     writer.setDtdEnabled(prefs->dtdEnabled());
+    writer.setChunkedLayerDataEnabled(prefs->chunkedLayerData());
 
     bool result = writer.writeMap(map, fileName);
     if (!result)
@@ -69,7 +70,11 @@ QByteArray TmxMapWriter::toByteArray(const Map *map)
     buffer.open(QIODevice::WriteOnly);
 
     MapWriter writer;
-    writer.writeMap(map, &buffer);
+    if (!writer.writeMap(map, &buffer)) {
+        mError = writer.errorString();
+        return QByteArray();
+    }
 
+    mError.clear();
     return bytes;
 }
@@ -49,6 +49,9 @@ public:
      * for storing a map in the clipboard. References to other files (like
      * tileset images) will be saved as absolute paths.
      *
+     * Returns an empty byte array when writing the map failed. The error can
+     * be obtained using errorString().
+     *
      * @see TmxMapReader::fromByteArray
      */
     QByteArray toByteArray(const Map *map);
@@ -27,6 +27,7 @@
  */
 
 #include "tmxrasterizer.h"
+#include "tilesetcache.h"
 
 #include <QGuiApplication>
 #include <QDebug>
@@ -156,6 +157,9 @@ int main(int argc, char *argv[])
     a.setApplicationName(QLatin1String("TmxRasterizer"));
     a.setApplicationVersion(QLatin1String("1.0"));
 
+    // Maps loaded by this tool share their external tilesets
+    Tiled::TilesetCache::setEnabled(true);
+
     CommandLineOptions options;
     parseCommandLineArguments(options);
 
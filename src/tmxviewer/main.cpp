@@ -27,6 +27,7 @@
  */
 
 #include "tmxviewer.h"
+#include "tilesetcache.h"
 
 #include <QApplication>
 #include <QDebug>
@@ -90,6 +91,9 @@ int main(int argc, char *argv[])
     a.setApplicationName(QLatin1String("TmxViewer"));
     a.setApplicationVersion(QLatin1String("1.0"));
 
+    // Maps loaded by this tool share their external tilesets
+    Tiled::TilesetCache::setEnabled(true);
+
     CommandLineOptions options;
     parseCommandLineArguments(options);
 
@@ -102,6 +102,9 @@ public:
         , mRenderer(renderer)
     {
         setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+
+        // Hidden layers are never painted, so their data is never decoded
+        setVisible(tileLayer->isVisible());
     }
 
     QRectF boundingRect() const
@@ -205,6 +208,7 @@ bool TmxViewer::viewMap(const QString &fileName)
     centerOn(0, 0);
 
     MapReader reader;
+    reader.setLazyLayerDataEnabled(true);
     mMap = reader.readMap(fileName);
     if (!mMap) {
         qWarning() << "Error:" << qPrintable(reader.errorString());
@@ -1,9 +1,16 @@
+#include "compression.h"
 #include "map.h"
 #include "mapobject.h"
 #include "objectgroup.h"
 #include "tilelayer.h"
 #include "mapreader.h"
+#include "mapwriter.h"
+#include "binarymapreader.h"
+#include "binarymapwriter.h"
 
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtEndian>
 #include <QtTest/QtTest>
 
 using namespace Tiled;
@@ -14,6 +21,14 @@ class test_MapReader : public QObject
 
 private slots:
     void loadMap();
+    void layerData();
+    void compressedLayerData();
+    void chunkedLayerData();
+    void unchunkedLayerData();
+    void manyLargeLayers();
+    void lazyLayerData();
+    void binaryMap();
+    void region();
 };
 
 void test_MapReader::loadMap()
@@ -53,5 +68,426 @@ void test_MapReader::loadMap()
     QCOMPARE(mapObject->height(), qreal(64));
 }
 
+void test_MapReader::layerData()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+
+    QVERIFY2(map, qPrintable(reader.errorString()));
+    QCOMPARE(map->layerCount(), 4);
+
+    // The same layer data is stored using each of the encodings, and is
+    // large enough to be decoded in several blocks and in parallel
+    const TileLayer *csvLayer = map->layerAt(0)->asTileLayer();
+    QVERIFY(csvLayer);
+    QVERIFY(!csvLayer->isEmpty());
+
+    for (int i = 1; i < map->layerCount(); ++i) {
+        const TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+        QVERIFY(tileLayer);
+        QVERIFY2(tileLayer->computeDiffRegion(csvLayer).isEmpty(),
+                 qPrintable(tileLayer->name()));
+    }
+}
+
+void test_MapReader::compressedLayerData()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    QScopedPointer<Map> compressedMap(reader.readMap("../data/compressedlayerdata.tmx"));
+
+    // Zstandard and LZ4 support are optional
+    if (!compressionSupported(Zstd) || !compressionSupported(Lz4)) {
+        QVERIFY(!compressedMap);
+        return;
+    }
+
+    QVERIFY2(compressedMap, qPrintable(reader.errorString()));
+    QCOMPARE(compressedMap->layerCount(), 2);
+
+    const TileLayer *csvLayer = map->layerAt(0)->asTileLayer();
+
+    for (int i = 0; i < compressedMap->layerCount(); ++i) {
+        const TileLayer *tileLayer = compressedMap->layerAt(i)->asTileLayer();
+        QVERIFY(tileLayer);
+        QVERIFY2(tileLayer->computeDiffRegion(csvLayer).isEmpty(),
+                 qPrintable(tileLayer->name()));
+    }
+}
+
+void test_MapReader::chunkedLayerData()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    // Make the layers sparse, leaving a part that doesn't align with chunks
+    for (int i = 0; i < map->layerCount(); ++i) {
+        TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+        QRegion erased(0, 0, tileLayer->width(), tileLayer->height());
+        erased -= QRegion(5, 7, 20, 11);
+        tileLayer->erase(erased);
+    }
+
+    const Map::LayerDataFormat formats[] = {
+        Map::XML, Map::CSV, Map::Base64, Map::Base64Gzip,
+        Map::Base64Zlib, Map::Base64Zstd, Map::Base64Lz4
+    };
+
+    for (Map::LayerDataFormat format : formats) {
+        if ((format == Map::Base64Zstd && !compressionSupported(Zstd)) ||
+                (format == Map::Base64Lz4 && !compressionSupported(Lz4)))
+            continue;
+
+        map->setLayerDataFormat(format);
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+
+        MapWriter writer;
+        writer.setChunkedLayerDataEnabled(true);
+        QVERIFY2(writer.writeMap(map.data(), &buffer, QLatin1String("../data")),
+                 qPrintable(writer.errorString()));
+        buffer.close();
+
+        buffer.open(QIODevice::ReadOnly);
+        QScopedPointer<Map> chunkedMap(reader.readMap(&buffer,
+                                                      QLatin1String("../data")));
+        QVERIFY2(chunkedMap, qPrintable(reader.errorString()));
+        QCOMPARE(chunkedMap->layerCount(), map->layerCount());
+
+        for (int i = 0; i < map->layerCount(); ++i) {
+            const TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+            const TileLayer *chunkedLayer = chunkedMap->layerAt(i)->asTileLayer();
+            QVERIFY(chunkedLayer);
+            QVERIFY2(chunkedLayer->computeDiffRegion(tileLayer).isEmpty(),
+                     qPrintable(chunkedLayer->name()));
+        }
+    }
+}
+
+void test_MapReader::unchunkedLayerData()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    const Map::LayerDataFormat formats[] = {
+        Map::XML, Map::CSV, Map::Base64, Map::Base64Gzip,
+        Map::Base64Zlib, Map::Base64Zstd, Map::Base64Lz4
+    };
+
+    for (Map::LayerDataFormat format : formats) {
+        if ((format == Map::Base64Zstd && !compressionSupported(Zstd)) ||
+                (format == Map::Base64Lz4 && !compressionSupported(Lz4)))
+            continue;
+
+        map->setLayerDataFormat(format);
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+
+        MapWriter writer;
+        writer.setChunkedLayerDataEnabled(false);
+        QVERIFY2(writer.writeMap(map.data(), &buffer, QLatin1String("../data")),
+                 qPrintable(writer.errorString()));
+        buffer.close();
+
+        QVERIFY(!buffer.data().contains("<chunk"));
+
+        buffer.open(QIODevice::ReadOnly);
+        QScopedPointer<Map> writtenMap(reader.readMap(&buffer,
+                                                      QLatin1String("../data")));
+        QVERIFY2(writtenMap, qPrintable(reader.errorString()));
+        QCOMPARE(writtenMap->layerCount(), map->layerCount());
+
+        for (int i = 0; i < map->layerCount(); ++i) {
+            const TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+            const TileLayer *writtenLayer = writtenMap->layerAt(i)->asTileLayer();
+            QVERIFY(writtenLayer);
+            QVERIFY2(writtenLayer->computeDiffRegion(tileLayer).isEmpty(),
+                     qPrintable(writtenLayer->name()));
+        }
+    }
+}
+
+void test_MapReader::manyLargeLayers()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    // More large layers than may be waiting to be decoded at once
+    const TileLayer *csvLayer = map->layerAt(0)->asTileLayer();
+    const int layerCount = QThreadPool::globalInstance()->maxThreadCount() * 4 + 1;
+    while (map->layerCount() < layerCount)
+        map->addLayer(csvLayer->clone());
+
+    map->setLayerDataFormat(Map::CSV);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+
+    MapWriter writer;
+    writer.setChunkedLayerDataEnabled(false);
+    QVERIFY2(writer.writeMap(map.data(), &buffer, QLatin1String("../data")),
+             qPrintable(writer.errorString()));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QScopedPointer<Map> writtenMap(reader.readMap(&buffer,
+                                                  QLatin1String("../data")));
+    QVERIFY2(writtenMap, qPrintable(reader.errorString()));
+    QCOMPARE(writtenMap->layerCount(), layerCount);
+
+    for (int i = 0; i < layerCount; ++i) {
+        const TileLayer *writtenLayer = writtenMap->layerAt(i)->asTileLayer();
+        QVERIFY(writtenLayer);
+        QVERIFY2(writtenLayer->computeDiffRegion(csvLayer).isEmpty(),
+                 qPrintable(writtenLayer->name()));
+    }
+}
+
+void test_MapReader::lazyLayerData()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    MapReader lazyReader;
+    lazyReader.setLazyLayerDataEnabled(true);
+    QScopedPointer<Map> lazyMap(lazyReader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(lazyMap, qPrintable(lazyReader.errorString()));
+    QCOMPARE(lazyMap->layerCount(), map->layerCount());
+
+    for (int i = 0; i < lazyMap->layerCount(); ++i)
+        QVERIFY(!lazyMap->layerAt(i)->asTileLayer()->isDecoded());
+
+    // Accessing the cells decodes a layer
+    TileLayer *lazyLayer = lazyMap->layerAt(0)->asTileLayer();
+    const TileLayer *tileLayer = map->layerAt(0)->asTileLayer();
+    QCOMPARE(lazyLayer->cellAt(0, 0), tileLayer->cellAt(0, 0));
+    QVERIFY(lazyLayer->isDecoded());
+    QVERIFY(!lazyMap->layerAt(1)->asTileLayer()->isDecoded());
+
+    QCOMPARE(lazyMap->decodeLayerData(), QString());
+
+    for (int i = 0; i < map->layerCount(); ++i) {
+        const TileLayer *layer = lazyMap->layerAt(i)->asTileLayer();
+        QVERIFY(layer->isDecoded());
+        QVERIFY2(layer->computeDiffRegion(map->layerAt(i)->asTileLayer()).isEmpty(),
+                 qPrintable(layer->name()));
+    }
+
+    // A changed layer can't be decoded again, so it keeps its cells
+    lazyLayer->setCell(0, 0, Cell());
+    QCOMPARE(lazyMap->discardDecodedLayerData(), map->layerCount() - 1);
+    QVERIFY(lazyLayer->isDecoded());
+    QVERIFY(!lazyMap->layerAt(1)->asTileLayer()->isDecoded());
+
+    const TileLayer *discardedLayer = lazyMap->layerAt(1)->asTileLayer();
+    QVERIFY(discardedLayer->computeDiffRegion(map->layerAt(1)->asTileLayer()).isEmpty());
+
+    // Corrupt layer data is only noticed once decoded, and a map with such a
+    // layer can't be saved, even after its cells were accessed
+    QBuffer corrupt;
+    corrupt.setData("<map version=\"1.0\" orientation=\"orthogonal\" width=\"4\" height=\"4\""
+                    " tilewidth=\"32\" tileheight=\"32\">"
+                    "<layer name=\"Corrupt\" width=\"4\" height=\"4\">"
+                    "<data encoding=\"base64\" compression=\"zlib\">AAAAAAAA</data>"
+                    "</layer></map>");
+    corrupt.open(QIODevice::ReadOnly);
+    QScopedPointer<Map> corruptMap(lazyReader.readMap(&corrupt));
+    QVERIFY2(corruptMap, qPrintable(lazyReader.errorString()));
+
+    TileLayer *corruptLayer = corruptMap->layerAt(0)->asTileLayer();
+    QCOMPARE(corruptLayer->cellAt(0, 0), Cell());
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    MapWriter writer;
+    QVERIFY(!writer.writeMap(corruptMap.data(), &buffer));
+    QVERIFY(!writer.errorString().isEmpty());
+    QVERIFY(buffer.data().isEmpty());
+}
+
+void test_MapReader::binaryMap()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QLatin1String("/layerdata.tmb");
+
+    // Small chunks, so that the layers are split over several of them
+    BinaryMapWriter writer;
+    writer.setChunkSize(QSize(16, 16));
+    QVERIFY2(writer.writeMap(map.data(), fileName),
+             qPrintable(writer.errorString()));
+
+    BinaryMapReader binaryReader;
+    QScopedPointer<Map> binaryMap(binaryReader.readMap(fileName));
+    QVERIFY2(binaryMap, qPrintable(binaryReader.errorString()));
+
+    QCOMPARE(binaryMap->width(), map->width());
+    QCOMPARE(binaryMap->height(), map->height());
+    QCOMPARE(binaryMap->tilesetCount(), map->tilesetCount());
+    QCOMPARE(binaryMap->layerCount(), map->layerCount());
+
+    for (int i = 0; i < map->layerCount(); ++i) {
+        const TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+        const TileLayer *binaryLayer = binaryMap->layerAt(i)->asTileLayer();
+        QVERIFY(binaryLayer);
+        QCOMPARE(binaryLayer->name(), tileLayer->name());
+        QCOMPARE(binaryLayer->size(), tileLayer->size());
+        QVERIFY2(binaryLayer->computeDiffRegion(tileLayer).isEmpty(),
+                 qPrintable(binaryLayer->name()));
+    }
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray contents = file.readAll();
+    file.close();
+
+    const int sectionCount = qFromLittleEndian<quint32>(
+                reinterpret_cast<const uchar*>(contents.constData() + 8));
+
+    // Returns the offset of the data of the first section of the given type
+    auto sectionOffset = [&] (quint32 type) {
+        for (int i = 0; i < sectionCount; ++i) {
+            const uchar *entry = reinterpret_cast<const uchar*>(contents.constData()) + 16 + i * 24;
+            if (qFromLittleEndian<quint32>(entry) == type)
+                return int(qFromLittleEndian<quint64>(entry + 8));
+        }
+        return -1;
+    };
+
+    auto readCorrupted = [&] (const QByteArray &corrupted) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+                file.write(corrupted) != corrupted.size())
+            return false;
+        file.close();
+
+        binaryMap.reset(binaryReader.readMap(fileName));
+        return !binaryMap && !binaryReader.errorString().isEmpty();
+    };
+
+    // A file claiming huge chunks is rejected rather than read out of bounds
+    QByteArray hugeChunks = contents;
+    const int layerOffset = sectionOffset(3); // TileLayerSection
+    QVERIFY(layerOffset >= 0);
+
+    // The chunk size follows the layer header, which has no properties
+    qToLittleEndian<quint32>(0xFFFFFFF0, reinterpret_cast<uchar*>(hugeChunks.data() + layerOffset + 40));
+    qToLittleEndian<quint32>(0xFFFFFFF0, reinterpret_cast<uchar*>(hugeChunks.data() + layerOffset + 44));
+    QVERIFY(readCorrupted(hugeChunks));
+
+    // So is a map with an invalid layer data format or a negative size
+    const int mapOffset = sectionOffset(1); // MapSection
+    QVERIFY(mapOffset >= 0);
+
+    QByteArray invalidFormat = contents;
+    invalidFormat[mapOffset + 4] = char(200);
+    QVERIFY(readCorrupted(invalidFormat));
+
+    QByteArray negativeWidth = contents;
+    qToLittleEndian<qint32>(-1, reinterpret_cast<uchar*>(negativeWidth.data() + mapOffset + 8));
+    QVERIFY(readCorrupted(negativeWidth));
+}
+
+void test_MapReader::region()
+{
+    MapReader reader;
+    QScopedPointer<Map> map(reader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    // A region that doesn't align with chunks
+    const QRect region(37, 21, 50, 40);
+
+    MapReader regionReader;
+    regionReader.setRegion(region);
+    QScopedPointer<Map> regionMap(regionReader.readMap("../data/layerdata.tmx"));
+    QVERIFY2(regionMap, qPrintable(regionReader.errorString()));
+
+    // Chunked layer data, where the chunks outside of the region are skipped
+    map->setLayerDataFormat(Map::Base64Zlib);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    MapWriter writer;
+    writer.setChunkedLayerDataEnabled(true);
+    QVERIFY2(writer.writeMap(map.data(), &buffer, QLatin1String("../data")),
+             qPrintable(writer.errorString()));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QScopedPointer<Map> chunkedMap(regionReader.readMap(&buffer,
+                                                        QLatin1String("../data")));
+    QVERIFY2(chunkedMap, qPrintable(regionReader.errorString()));
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QLatin1String("/layerdata.tmb");
+
+    BinaryMapWriter binaryWriter;
+    binaryWriter.setChunkSize(QSize(16, 16));
+    QVERIFY2(binaryWriter.writeMap(map.data(), fileName),
+             qPrintable(binaryWriter.errorString()));
+
+    BinaryMapReader binaryReader;
+    binaryReader.setRegion(region);
+    QScopedPointer<Map> binaryMap(binaryReader.readMap(fileName));
+    QVERIFY2(binaryMap, qPrintable(binaryReader.errorString()));
+
+    const Map *regionMaps[] = {
+        regionMap.data(), chunkedMap.data(), binaryMap.data()
+    };
+
+    for (const Map *partialMap : regionMaps) {
+        QCOMPARE(partialMap->size(), map->size());
+        QCOMPARE(partialMap->layerCount(), map->layerCount());
+
+        for (int i = 0; i < map->layerCount(); ++i) {
+            const TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+            const TileLayer *regionLayer = partialMap->layerAt(i)->asTileLayer();
+            QVERIFY(regionLayer);
+            QCOMPARE(regionLayer->position(), region.topLeft());
+            QCOMPARE(regionLayer->size(), region.size());
+            QVERIFY2(regionLayer->computeDiffRegion(tileLayer).isEmpty(),
+                     qPrintable(regionLayer->name()));
+        }
+    }
+
+    // Invalid tiles are reported at their position in the layer
+    QBuffer invalid;
+    invalid.setData("<map version=\"1.0\" orientation=\"orthogonal\" width=\"4\" height=\"4\""
+                    " tilewidth=\"32\" tileheight=\"32\">"
+                    "<layer name=\"Invalid\" width=\"4\" height=\"4\">"
+                    "<data encoding=\"csv\">0,0,0,0,0,0,x,0,0,0,0,0,0,0,0,0</data>"
+                    "</layer></map>");
+    invalid.open(QIODevice::ReadOnly);
+    regionReader.setRegion(QRect(2, 1, 2, 3));
+    QScopedPointer<Map> invalidMap(regionReader.readMap(&invalid));
+    QVERIFY(!invalidMap);
+    QVERIFY2(regionReader.errorString().contains(QLatin1String("(3,2)")),
+             qPrintable(regionReader.errorString()));
+
+    // Objects are only read when they intersect the region
+    regionReader.setRegion(QRect(0, 0, 5, 5));
+    QScopedPointer<Map> objectMap(regionReader.readMap("../data/mapobject.tmx"));
+    QVERIFY2(objectMap, qPrintable(regionReader.errorString()));
+    QCOMPARE(objectMap->layerAt(1)->asObjectGroup()->objectCount(), 0);
+
+    regionReader.setRegion(QRect(8, 7, 10, 10));
+    objectMap.reset(regionReader.readMap("../data/mapobject.tmx"));
+    QVERIFY2(objectMap, qPrintable(regionReader.errorString()));
+    QCOMPARE(objectMap->layerAt(1)->asObjectGroup()->objectCount(), 1);
+}
+
 QTEST_MAIN(test_MapReader)
 #include "test_mapreader.moc"
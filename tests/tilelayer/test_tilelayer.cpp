@@ -0,0 +1,371 @@
+#include "tile.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+
+class test_TileLayer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void region_data();
+    void region();
+
+    void regionBenchmark_data();
+    void regionBenchmark();
+
+    void tilesetUseCounts();
+
+    void flip_data();
+    void flip();
+
+    void rotate_data();
+    void rotate();
+
+    void rowSpans();
+    void fillAndBlit();
+
+private:
+    TileLayer *checkerboard(int size, int cellSize) const;
+
+    SharedTileset mTileset;
+};
+
+/**
+ * The way TileLayer::region() used to build its result, by uniting the
+ * region with each horizontal run of cells. Used as a reference.
+ */
+static QRegion regionByUnion(const TileLayer *layer)
+{
+    QRegion region;
+
+    for (int y = 0; y < layer->height(); ++y) {
+        for (int x = 0; x < layer->width(); ++x) {
+            if (!layer->cellAt(x, y).isEmpty()) {
+                const int rangeStart = x;
+                for (++x; x <= layer->width(); ++x) {
+                    if (x == layer->width() || layer->cellAt(x, y).isEmpty()) {
+                        region += QRect(rangeStart + layer->x(),
+                                        y + layer->y(),
+                                        x - rangeStart, 1);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return region;
+}
+
+void test_TileLayer::initTestCase()
+{
+    mTileset = Tileset::create(QLatin1String("tileset"), 32, 32);
+    mTileset->addTile(QPixmap());
+}
+
+/**
+ * Returns a layer of \a size by \a size cells, filled in a checkerboard
+ * pattern with squares of \a cellSize by \a cellSize cells.
+ */
+TileLayer *test_TileLayer::checkerboard(int size, int cellSize) const
+{
+    TileLayer *layer = new TileLayer(QString(), 3, 5, size, size);
+    const Cell cell(mTileset->tileAt(0));
+
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+            if (((x / cellSize) + (y / cellSize)) % 2 == 0)
+                layer->setCell(x, y, cell);
+
+    return layer;
+}
+
+void test_TileLayer::region_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("cellSize");
+
+    QTest::newRow("empty") << 0 << 1;
+    QTest::newRow("single cell") << 1 << 1;
+    QTest::newRow("checkerboard") << 37 << 1;
+    QTest::newRow("squares") << 100 << 3;
+    QTest::newRow("chunk-sized squares") << 64 << CHUNK_SIZE;
+}
+
+void test_TileLayer::region()
+{
+    QFETCH(int, size);
+    QFETCH(int, cellSize);
+
+    QScopedPointer<TileLayer> layer(checkerboard(size, cellSize));
+
+    const QRegion expected = regionByUnion(layer.data());
+    const QRegion region = layer->region();
+
+    QCOMPARE(region.boundingRect(), expected.boundingRect());
+    QVERIFY(region.xored(expected).isEmpty());
+}
+
+void test_TileLayer::regionBenchmark_data()
+{
+    QTest::addColumn<bool>("singlePass");
+
+    QTest::newRow("union") << false;
+    QTest::newRow("single pass") << true;
+}
+
+void test_TileLayer::regionBenchmark()
+{
+    QFETCH(bool, singlePass);
+
+    QScopedPointer<TileLayer> layer(checkerboard(2048, 1));
+    QRegion region;
+
+    if (singlePass) {
+        QBENCHMARK_ONCE {
+            region = layer->region();
+        }
+    } else {
+        QBENCHMARK_ONCE {
+            region = regionByUnion(layer.data());
+        }
+    }
+
+    QCOMPARE(region.boundingRect(), QRect(3, 5, 2048, 2048));
+}
+
+/**
+ * Counts the cells of \a layer that refer to \a tileset, by looking at every
+ * cell. Used as a reference.
+ */
+static int countTilesetUse(const TileLayer *layer, const Tileset *tileset)
+{
+    int count = 0;
+
+    for (int y = 0; y < layer->height(); ++y) {
+        for (int x = 0; x < layer->width(); ++x) {
+            const Tile *tile = layer->cellAt(x, y).tile;
+            if (tile && tile->tileset() == tileset)
+                ++count;
+        }
+    }
+
+    return count;
+}
+
+void test_TileLayer::tilesetUseCounts()
+{
+    QScopedPointer<TileLayer> layer(checkerboard(37, 1));
+    const Tileset *tileset = mTileset.data();
+
+    QCOMPARE(layer->tilesetUseCount(tileset), (37 * 37 + 1) / 2);
+
+    layer->erase(QRect(5, 5, 10, 10));
+    QCOMPARE(layer->tilesetUseCount(tileset), countTilesetUse(layer.data(), tileset));
+
+    layer->resize(QSize(20, 30), QPoint(-3, 2));
+    QCOMPARE(layer->tilesetUseCount(tileset), countTilesetUse(layer.data(), tileset));
+
+    QScopedPointer<TileLayer> copy(layer->copy(QRect(0, 0, 16, 16)));
+    QCOMPARE(copy->tilesetUseCount(tileset), countTilesetUse(copy.data(), tileset));
+
+    SharedTileset other = Tileset::create(QLatin1String("other"), 32, 32);
+    other->addTile(QPixmap());
+
+    const int count = layer->tilesetUseCount(tileset);
+    layer->replaceReferencesToTileset(mTileset.data(), other.data());
+    QVERIFY(!layer->referencesTileset(tileset));
+    QCOMPARE(layer->tilesetUseCount(other.data()), count);
+
+    layer->erase(QRect(0, 0, layer->width(), layer->height()));
+    QVERIFY(layer->usedTilesets().isEmpty());
+}
+
+/**
+ * Returns a layer of \a width by \a height with a pattern of cells using all
+ * combinations of flip flags.
+ */
+static TileLayer *patternLayer(int width, int height, Tile *tile)
+{
+    TileLayer *layer = new TileLayer(QString(), 0, 0, width, height);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const int pattern = x * 7 + y * 3;
+            if (pattern % 5 == 0)
+                continue;
+
+            Cell cell(tile);
+            cell.flippedHorizontally = (pattern & 1) != 0;
+            cell.flippedVertically = (pattern & 2) != 0;
+            cell.flippedAntiDiagonally = (pattern & 4) != 0;
+            layer->setCell(x, y, cell);
+        }
+    }
+
+    return layer;
+}
+
+void test_TileLayer::flip_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<int>("direction");
+
+    const QSize sizes[] = { QSize(1, 1), QSize(16, 32), QSize(37, 21) };
+
+    for (const QSize &size : sizes) {
+        const QByteArray name = QByteArray::number(size.width()) + "x" +
+                QByteArray::number(size.height());
+        QTest::newRow(name + " horizontal") << size << int(FlipHorizontally);
+        QTest::newRow(name + " vertical") << size << int(FlipVertically);
+    }
+}
+
+void test_TileLayer::flip()
+{
+    QFETCH(QSize, size);
+    QFETCH(int, direction);
+
+    QScopedPointer<TileLayer> layer(patternLayer(size.width(), size.height(),
+                                                 mTileset->tileAt(0)));
+    QScopedPointer<TileLayer> original(static_cast<TileLayer*>(layer->clone()));
+
+    layer->flip(static_cast<FlipDirection>(direction));
+
+    QCOMPARE(layer->size(), size);
+
+    for (int y = 0; y < size.height(); ++y) {
+        for (int x = 0; x < size.width(); ++x) {
+            Cell expected;
+
+            if (direction == FlipHorizontally) {
+                expected = original->cellAt(size.width() - x - 1, y);
+                expected.flippedHorizontally = !expected.flippedHorizontally;
+            } else {
+                expected = original->cellAt(x, size.height() - y - 1);
+                expected.flippedVertically = !expected.flippedVertically;
+            }
+
+            if (expected.isEmpty())
+                expected = Cell();
+
+            QCOMPARE(layer->cellAt(x, y), expected);
+        }
+    }
+}
+
+void test_TileLayer::rotate_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<int>("direction");
+
+    const QSize sizes[] = { QSize(1, 1), QSize(16, 32), QSize(37, 21) };
+
+    for (const QSize &size : sizes) {
+        const QByteArray name = QByteArray::number(size.width()) + "x" +
+                QByteArray::number(size.height());
+        QTest::newRow(name + " left") << size << int(RotateLeft);
+        QTest::newRow(name + " right") << size << int(RotateRight);
+    }
+}
+
+void test_TileLayer::rotate()
+{
+    QFETCH(QSize, size);
+    QFETCH(int, direction);
+
+    QScopedPointer<TileLayer> layer(patternLayer(size.width(), size.height(),
+                                                 mTileset->tileAt(0)));
+    QScopedPointer<TileLayer> original(static_cast<TileLayer*>(layer->clone()));
+
+    // Rotating four times in the same direction restores the layer
+    for (int i = 0; i < 4; ++i) {
+        layer->rotate(static_cast<RotateDirection>(direction));
+        QCOMPARE(layer->size(), i % 2 == 0 ? size.transposed() : size);
+    }
+
+    QVERIFY(layer->computeDiffRegion(original.data()).isEmpty());
+
+    // A single rotation moves each cell and makes it anti-diagonally flipped
+    // exactly when it wasn't before
+    layer->rotate(static_cast<RotateDirection>(direction));
+
+    for (int y = 0; y < size.height(); ++y) {
+        for (int x = 0; x < size.width(); ++x) {
+            const Cell before = original->cellAt(x, y);
+            const Cell after = direction == RotateRight ?
+                        layer->cellAt(size.height() - y - 1, x) :
+                        layer->cellAt(y, size.width() - x - 1);
+
+            QCOMPARE(after.tile, before.tile);
+            if (!before.isEmpty())
+                QCOMPARE(after.flippedAntiDiagonally, !before.flippedAntiDiagonally);
+        }
+    }
+}
+
+void test_TileLayer::rowSpans()
+{
+    TileLayer layer(QString(), 0, 0, 40, 3);
+    Tile *tile = mTileset->tileAt(0);
+
+    QVector<Cell> cells(37);
+    for (int i = 0; i < cells.size(); i += 2) {
+        cells[i] = Cell(tile);
+        cells[i].flippedVertically = (i % 3) == 0;
+    }
+
+    layer.setCells(2, 1, cells.size(), cells.constData());
+
+    QVector<Cell> read(cells.size());
+    layer.getCells(2, 1, read.size(), read.data());
+    QCOMPARE(read, cells);
+
+    QCOMPARE(layer.cellAt(1, 1), Cell());
+    QCOMPARE(layer.cellAt(3, 1), Cell());
+    QCOMPARE(layer.cellAt(4, 1), cells.at(2));
+    QCOMPARE(layer.tilesetUseCount(mTileset.data()), (cells.size() + 1) / 2);
+
+    // Merging leaves cells alone where the merged cells are empty
+    QVector<Cell> other(cells.size());
+    other[1] = Cell(tile);
+    layer.mergeCells(2, 1, other.size(), other.constData());
+
+    QCOMPARE(layer.cellAt(2, 1), cells.at(0));
+    QCOMPARE(layer.cellAt(3, 1), Cell(tile));
+}
+
+void test_TileLayer::fillAndBlit()
+{
+    TileLayer layer(QString(), 0, 0, 50, 50);
+    const Cell cell(mTileset->tileAt(0));
+
+    layer.fill(QRect(-5, 10, 30, 20), cell);
+    QCOMPARE(layer.region(), QRegion(0, 10, 25, 20));
+
+    QScopedPointer<TileLayer> source(checkerboard(20, 1));
+
+    // Blit a part that sticks out of this layer on the right
+    layer.blit(40, 0, source.data(), QRect(5, 5, 15, 15));
+
+    for (int y = 0; y < 15; ++y)
+        for (int x = 40; x < 50; ++x)
+            QCOMPARE(layer.cellAt(x, y), source->cellAt(x - 35, y + 5));
+
+    // Skipping empty cells keeps the filled area intact
+    layer.blit(0, 10, source.data(), QRect(0, 0, 20, 20), true);
+    QCOMPARE(layer.cellAt(1, 10), cell);
+
+    layer.erase(QRect(0, 0, 50, 50));
+    QVERIFY(layer.isEmpty());
+    QCOMPARE(layer.tilesetUseCount(mTileset.data()), 0);
+}
+
+QTEST_MAIN(test_TileLayer)
+#include "test_tilelayer.moc"